@@ -29,5 +29,17 @@
 #define KERNEL_MEMCPY         3
 #define KERNEL_GET_CFW_CONFIG 4
 #define KERNEL_READ_OTP       5
+#define KERNEL_VECTOR         6
+#define KERNEL_MEMSET         7
+
+// KERNEL_VECTOR(kernel_vector_op_t *ops, u32 count, u32 *out) runs count of these
+// in a single privileged window, out receives one word per op (the READ32 value, else 0).
+// It returns the number of ops executed, which stops early at the first unknown op.
+typedef struct {
+    unsigned int op;      // KERNEL_READ32, KERNEL_WRITE32, KERNEL_MEMCPY or KERNEL_MEMSET
+    unsigned int address; // destination, or source of READ32
+    unsigned int value;   // WRITE32/MEMSET value, MEMCPY source
+    unsigned int size;    // MEMCPY/MEMSET size in bytes
+} kernel_vector_op_t;
 
 #endif
@@ -21,6 +21,7 @@
  * 3. This notice may not be removed or altered from any source
  * distribution.
  ***************************************************************************/
+#include "fsa.h"
 #include "types.h"
 #include "utils.h"
 
@@ -100,13 +101,11 @@ static int FSA_RawClose(int fd, int device_handle) {
     return ret;
 }
 
-static int FSA_RawRead(int fd, void *data, u32 size_bytes, u32 cnt, u64 blocks_offset, int device_handle) {
-    u8 *iobuf      = allocIobuf();
-    u8 *inbuf8     = iobuf;
-    u8 *outbuf8    = &iobuf[0x520];
+// iobuf is reused by the raw SD session, so only the words FSA reads are set up here
+static int FSA_RawReadWrite(int fd, u8 *iobuf, void *data, u32 size_bytes, u32 cnt, u64 blocks_offset, int device_handle, int read) {
+    u32 *inbuf     = (u32 *) iobuf;
+    u32 *outbuf    = (u32 *) &iobuf[0x520];
     iovec_s *iovec = (iovec_s *) &iobuf[0x7C0];
-    u32 *inbuf     = (u32 *) inbuf8;
-    u32 *outbuf    = (u32 *) outbuf8;
 
     // note : offset_bytes = blocks_offset * size_bytes
     inbuf[0x08 / 4] = (blocks_offset >> 32);
@@ -124,97 +123,140 @@ static int FSA_RawRead(int fd, void *data, u32 size_bytes, u32 cnt, u64 blocks_o
     iovec[2].ptr = outbuf;
     iovec[2].len = 0x293;
 
-    int ret = svcIoctlv(fd, 0x6B, 1, 2, iovec);
-
-    freeIobuf(iobuf);
-    return ret;
+    if (read) {
+        return svcIoctlv(fd, 0x6B, 1, 2, iovec);
+    }
+    return svcIoctlv(fd, 0x6C, 2, 1, iovec);
 }
 
-static int FSA_RawWrite(int fd, void *data, u32 size_bytes, u32 cnt, u64 blocks_offset, int device_handle) {
-    u8 *iobuf      = allocIobuf();
-    u8 *inbuf8     = iobuf;
-    u8 *outbuf8    = &iobuf[0x520];
-    iovec_s *iovec = (iovec_s *) &iobuf[0x7C0];
-    u32 *inbuf     = (u32 *) inbuf8;
-    u32 *outbuf    = (u32 *) outbuf8;
-
-    inbuf[0x08 / 4] = (blocks_offset >> 32);
-    inbuf[0x0C / 4] = (blocks_offset & 0xFFFFFFFF);
-    inbuf[0x10 / 4] = cnt;
-    inbuf[0x14 / 4] = size_bytes;
-    inbuf[0x18 / 4] = device_handle;
-
-    iovec[0].ptr = inbuf;
-    iovec[0].len = 0x520;
-
-    iovec[1].ptr = data;
-    iovec[1].len = size_bytes * cnt;
-
-    iovec[2].ptr = outbuf;
-    iovec[2].len = 0x293;
-
-    int ret = svcIoctlv(fd, 0x6C, 2, 1, iovec);
-
-    freeIobuf(iobuf);
-    return ret;
+// The raw SD session keeps /dev/fsa, the raw device handle, the iobuf and the bounce buffer open
+// from the first FSA_SDSessionOpen until the matching last FSA_SDSessionClose.
+static int sdSessionFsa    = -1;
+static int sdSessionHandle = -1;
+static u8 *sdSessionIobuf  = 0;
+static u8 *sdSessionBounce = 0;
+static u32 sdSessionRefs   = 0;
+
+static void FSA_SDSessionTeardown(void) {
+    if (sdSessionHandle >= 0) {
+        FSA_RawClose(sdSessionFsa, sdSessionHandle);
+        sdSessionHandle = -1;
+    }
+    if (sdSessionFsa >= 0) {
+        FSA_Close(sdSessionFsa);
+        sdSessionFsa = -1;
+    }
+    if (sdSessionBounce) {
+        svcFree(0xCAFF, sdSessionBounce);
+        sdSessionBounce = 0;
+    }
+    if (sdSessionIobuf) {
+        freeIobuf(sdSessionIobuf);
+        sdSessionIobuf = 0;
+    }
 }
 
-int FSA_SDReadRawSectors(void *buffer, u32 sector, u32 num_sectors) {
-    int fsa = FSA_Open();
-    if (fsa < 0)
-        return fsa;
+int FSA_SDSessionOpen(void) {
+    if (sdSessionRefs) {
+        sdSessionRefs++;
+        return 0;
+    }
 
-    int fd;
-    int res = FSA_RawOpen(fsa, "/dev/sdcard01", &fd);
+    sdSessionIobuf  = allocIobuf();
+    sdSessionBounce = svcAllocAlign(0xCAFF, SD_BOUNCE_SECTORS << 9, 0x40);
+    if (!sdSessionIobuf || !sdSessionBounce) {
+        FSA_SDSessionTeardown();
+        return -2;
+    }
+
+    int res = FSA_Open();
     if (res < 0) {
-        FSA_Close(fsa);
+        FSA_SDSessionTeardown();
         return res;
     }
+    sdSessionFsa = res;
 
-    void *buf = svcAllocAlign(0xCAFF, num_sectors << 9, 0x40);
-    if (!buf) {
-        FSA_RawClose(fsa, fd);
-        FSA_Close(fsa);
-        return -2;
+    int fd;
+    res = FSA_RawOpen(sdSessionFsa, "/dev/sdcard01", &fd);
+    if (res < 0) {
+        FSA_SDSessionTeardown();
+        return res;
     }
+    sdSessionHandle = fd;
 
-    res = FSA_RawRead(fsa, buf, 0x200, num_sectors, sector, fd);
-
-    kernel_memcpy(buffer, buf, num_sectors << 9);
+    sdSessionRefs = 1;
+    return 0;
+}
 
-    svcFree(0xCAFF, buf);
-    FSA_RawClose(fsa, fd);
-    FSA_Close(fsa);
+void FSA_SDSessionClose(void) {
+    if (sdSessionRefs && --sdSessionRefs == 0) {
+        FSA_SDSessionTeardown();
+    }
+}
 
+static int FSA_SDRawSectorRuns(const sd_sector_run_t *runs, u32 count, int read) {
+    if (!sdSessionRefs)
+        return -1;
+
+    int res = 0;
+    for (u32 i = 0; i < count; i++) {
+        u8 *buffer  = (u8 *) runs[i].buffer;
+        u32 sector  = runs[i].sector;
+        u32 sectors = runs[i].num_sectors;
+
+        // FSA transfers straight into 0x40 aligned buffers
+        if (!((u32) buffer & 0x3F)) {
+            res = FSA_RawReadWrite(sdSessionFsa, sdSessionIobuf, buffer, 0x200, sectors, sector, sdSessionHandle, read);
+            if (res < 0)
+                return res;
+            continue;
+        }
+
+        // everything else goes through the bounce buffer of the session, in chunks of its size
+        while (sectors) {
+            u32 chunk = sectors > SD_BOUNCE_SECTORS ? SD_BOUNCE_SECTORS : sectors;
+            if (!read)
+                kernel_memcpy(sdSessionBounce, buffer, chunk << 9);
+
+            res = FSA_RawReadWrite(sdSessionFsa, sdSessionIobuf, sdSessionBounce, 0x200, chunk, sector, sdSessionHandle, read);
+            if (res < 0)
+                return res;
+
+            if (read)
+                kernel_memcpy(buffer, sdSessionBounce, chunk << 9);
+            buffer += chunk << 9;
+            sector += chunk;
+            sectors -= chunk;
+        }
+    }
     return res;
 }
 
-int FSA_SDWriteRawSectors(const void *buffer, u32 sector, u32 num_sectors) {
-    int fsa = FSA_Open();
-    if (fsa < 0)
-        return fsa;
+int FSA_SDReadRawSectorRuns(const sd_sector_run_t *runs, u32 count) {
+    return FSA_SDRawSectorRuns(runs, count, 1);
+}
 
-    int fd;
-    int res = FSA_RawOpen(fsa, "/dev/sdcard01", &fd);
-    if (res < 0) {
-        FSA_Close(fsa);
-        return res;
-    }
+int FSA_SDWriteRawSectorRuns(const sd_sector_run_t *runs, u32 count) {
+    return FSA_SDRawSectorRuns(runs, count, 0);
+}
 
-    void *buf = svcAllocAlign(0xCAFF, num_sectors << 9, 0x40);
-    if (!buf) {
-        FSA_RawClose(fsa, fd);
-        FSA_Close(fsa);
-        return -2;
-    }
+// the single run calls work without an open session as well, then they set one up just for the call
+static int FSA_SDRawSectors(void *buffer, u32 sector, u32 num_sectors, int read) {
+    int res = FSA_SDSessionOpen();
+    if (res < 0)
+        return res;
 
-    kernel_memcpy(buf, buffer, num_sectors << 9);
+    sd_sector_run_t run = {sector, num_sectors, buffer};
+    res                 = FSA_SDRawSectorRuns(&run, 1, read);
 
-    res = FSA_RawWrite(fsa, buf, 0x200, num_sectors, sector, fd);
+    FSA_SDSessionClose();
+    return res;
+}
 
-    svcFree(0xCAFF, buf);
-    FSA_RawClose(fsa, fd);
-    FSA_Close(fsa);
+int FSA_SDReadRawSectors(void *buffer, u32 sector, u32 num_sectors) {
+    return FSA_SDRawSectors(buffer, sector, num_sectors, 1);
+}
 
-    return res;
+int FSA_SDWriteRawSectors(const void *buffer, u32 sector, u32 num_sectors) {
+    return FSA_SDRawSectors((void *) buffer, sector, num_sectors, 0);
 }
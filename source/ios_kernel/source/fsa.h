@@ -48,6 +48,26 @@ typedef struct _sdio_nand_signature_sector_t {
     stdio_nand_desc_t nand_descriptions[NAND_MAX_DESC_TYPES];
 } __attribute__((packed)) sdio_nand_signature_sector_t;
 
+typedef struct _sd_sector_run_t {
+    u32 sector;      // first SD sector
+    u32 num_sectors; // number of 0x200 byte sectors
+    void *buffer;    // should be 0x40 aligned, anything else is bounced
+} sd_sector_run_t;
+
+#define SD_BOUNCE_SECTORS 0x40 // bounce buffer of the raw SD session, unaligned runs are split into chunks of it
+
+// A consumer opens the raw SD session once, does all of its sector runs and closes it again.
+// Opens nest, the last close releases the handles and buffers.
+int FSA_SDSessionOpen(void);
+
+void FSA_SDSessionClose(void);
+
+// Need an open session, they fail with -1 otherwise.
+int FSA_SDReadRawSectorRuns(const sd_sector_run_t *runs, u32 count);
+
+int FSA_SDWriteRawSectorRuns(const sd_sector_run_t *runs, u32 count);
+
+// Use the open session or set one up just for the call.
 int FSA_SDReadRawSectors(void *buffer, u32 sector, u32 num_sectors);
 
 int FSA_SDWriteRawSectors(const void *buffer, u32 sector, u32 num_sectors);
@@ -65,6 +65,8 @@ void instant_patches_setup(void) {
     *(volatile u32 *) (0x05022474 - 0x05000000 + 0x081C0000) = 0xFFFFFFFF; // NEW_TIMEOUT
 
     kernel_memset((void *) (0x050BD000 - 0x05000000 + 0x081C0000), 0, 0x2F00);
+    // the payload copy only covers the code of the extension region
+    kernel_memset((void *) (_ext_bss_start - 0x05100000 + 0x13D80000), 0, _ext_bss_end - _ext_bss_start);
 
     // allow custom bootLogoTex and bootMovie.h264
     *(volatile u32 *) (0xE0030D68 - 0xE0000000 + 0x12900000) = 0xE3A00000; // mov r0, #0
@@ -125,4 +127,15 @@ void instant_patches_setup(void) {
     map_info.type   = 3; // 0 = undefined, 1 = kernel only, 2 = read only, 3 = read write
     map_info.cached = 0xFFFFFFFF;
     _iosMapSharedUserExecution(&map_info);
+
+    // the extension region with the optional features of ios_mcp, its code and .bss
+    if (_ext_bss_end > _ext_start) {
+        map_info.paddr  = _ext_start - 0x05100000 + 0x13D80000;
+        map_info.vaddr  = _ext_start;
+        map_info.size   = (_ext_bss_end - _ext_start + 0xFFF) & ~0xFFF;
+        map_info.domain = 1; // MCP
+        map_info.type   = 3; // 0 = undefined, 1 = kernel only, 2 = read only, 3 = read write
+        map_info.cached = 0xFFFFFFFF;
+        _iosMapSharedUserExecution(&map_info);
+    }
 }
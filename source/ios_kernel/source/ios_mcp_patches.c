@@ -42,6 +42,11 @@ void mcp_run_patches(u32 ios_elf_start) {
     // We can't use "_text_end" here because we need to copy the full 0x4000 to preserve the envrionmen path which
     // is at the end of the .text section.
     section_write(ios_elf_start, _text_start, (void *) mcp_get_phys_code_base(), 0x4000);
+    // the optional features follow in the extension region, see ios_mcp's link.ld
+    if (_ext_bss_end > _ext_start) {
+        section_write(ios_elf_start, _ext_start, (void *) (_ext_start + MCP_CODE_BASE_PHYS_ADDR), _ext_end - _ext_start);
+        section_write_bss(ios_elf_start, _ext_bss_start, _ext_bss_end - _ext_bss_start);
+    }
 
     u32 patch_count = (u32) (((u8 *) mcp_patches_table_end) - ((u8 *) mcp_patches_table)) / sizeof(patch_table_t);
     patch_table_entries(ios_elf_start, mcp_patches_table, patch_count);
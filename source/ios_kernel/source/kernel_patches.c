@@ -55,6 +55,34 @@ static const u32 KERNEL_MCP_IOMAPPINGS_STRUCT[] =
 ThreadContext_t **currentThreadContext = (ThreadContext_t **) 0x08173ba0;
 uint32_t *domainAccessPermissions      = (uint32_t *) 0x081a4000;
 
+// must be called with interrupts disabled and the kernel domain set
+static int kernel_run_vector(const kernel_vector_op_t *ops, u32 count, u32 *out) {
+    for (u32 i = 0; i < count; i++) {
+        const kernel_vector_op_t *op = &ops[i];
+        u32 result                   = 0;
+        switch (op->op) {
+            case KERNEL_READ32:
+                result = *(volatile u32 *) op->address;
+                break;
+            case KERNEL_WRITE32:
+                *(volatile u32 *) op->address = op->value;
+                break;
+            case KERNEL_MEMCPY:
+                kernel_memcpy((void *) op->address, (void *) op->value, op->size);
+                break;
+            case KERNEL_MEMSET:
+                kernel_memset((void *) op->address, op->value, op->size);
+                break;
+            default:
+                return i;
+        }
+        if (out) {
+            out[i] = result;
+        }
+    }
+    return count;
+}
+
 int kernel_syscall_0x81(u32 command, u32 arg1, u32 arg2, u32 arg3) {
     int result = 0;
     int level  = disable_interrupts();
@@ -82,6 +110,14 @@ int kernel_syscall_0x81(u32 command, u32 arg1, u32 arg2, u32 arg3) {
             read_otp_internal(0, (void *) (arg1), 0x400);
             break;
         }
+        case KERNEL_VECTOR: {
+            result = kernel_run_vector((const kernel_vector_op_t *) arg1, arg2, (u32 *) arg3);
+            break;
+        }
+        case KERNEL_MEMSET: {
+            kernel_memset((void *) arg1, arg2, arg3);
+            break;
+        }
         default: {
             result = -1;
             break;
@@ -0,0 +1,248 @@
+#include "RemoteMemory.h"
+
+#include <cstring>
+#include <vector>
+
+namespace remotemem {
+
+RemoteMemory::RemoteMemory(WupClient &client, size_t maxPages, uint32_t prefetchPages)
+    : mClient(client), mMaxPages(maxPages ? maxPages : 1), mPrefetchPages(prefetchPages) {
+}
+
+RemoteMemory::~RemoteMemory() {
+    flush();
+}
+
+bool RemoteMemory::read(uint32_t address, void *out, size_t size) {
+    auto *dst = static_cast<uint8_t *>(out);
+    while (size) {
+        uint32_t base   = address & ~(PAGE_SIZE - 1);
+        uint32_t offset = address - base;
+        size_t chunk    = size < PAGE_SIZE - offset ? size : PAGE_SIZE - offset;
+
+        Page *page = lookup(base, true);
+        if (!page) {
+            return false;
+        }
+        memcpy(dst, page->data.data() + offset, chunk);
+
+        address += chunk;
+        dst += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool RemoteMemory::write(uint32_t address, const void *data, size_t size) {
+    auto *src = static_cast<const uint8_t *>(data);
+    while (size) {
+        uint32_t base   = address & ~(PAGE_SIZE - 1);
+        uint32_t offset = address - base;
+        size_t chunk    = size < PAGE_SIZE - offset ? size : PAGE_SIZE - offset;
+
+        // writes don't need the old contents, the page is only marked dirty where written
+        Page *page = lookup(base, false);
+        memcpy(page->data.data() + offset, src, chunk);
+        for (size_t i = 0; i < chunk; i++) {
+            page->dirty.set(offset + i);
+        }
+
+        address += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool RemoteMemory::flush() {
+    bool res = flushRange(mPages.begin(), mPages.end());
+
+    // pages that only existed to hold writes are not needed anymore
+    for (auto it = mPages.begin(); it != mPages.end();) {
+        if (!it->second.valid && it->second.dirty.none()) {
+            it = mPages.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return res;
+}
+
+void RemoteMemory::invalidate() {
+    invalidatePages(mPages.begin(), mPages.end());
+}
+
+void RemoteMemory::invalidate(uint32_t address, size_t size) {
+    if (!size) {
+        return;
+    }
+    uint64_t end = static_cast<uint64_t>(address) + size;
+    invalidatePages(mPages.lower_bound(address & ~(PAGE_SIZE - 1)), end > UINT32_MAX ? mPages.end() : mPages.lower_bound(static_cast<uint32_t>(end)));
+}
+
+void RemoteMemory::invalidatePages(std::map<uint32_t, Page>::iterator it, std::map<uint32_t, Page>::iterator last) {
+    while (it != last) {
+        if (it->second.dirty.none()) {
+            it = mPages.erase(it);
+        } else {
+            it->second.valid = false;
+            ++it;
+        }
+    }
+}
+
+RemoteMemory::Page *RemoteMemory::lookup(uint32_t base, bool fetchPage) {
+    auto it = mPages.find(base);
+    if (it != mPages.end() && (it->second.valid || !fetchPage)) {
+        if (fetchPage) {
+            mStats.hits++;
+        }
+        it->second.lastUse = ++mUseCounter;
+        return &it->second;
+    }
+
+    if (fetchPage) {
+        mStats.misses++;
+        if (!fetch(base)) {
+            return nullptr;
+        }
+    } else {
+        mPages[base].lastUse = ++mUseCounter;
+        evict(base, base);
+    }
+    return &mPages[base];
+}
+
+bool RemoteMemory::fetch(uint32_t base) {
+    // the requested page plus the following pages that are not cached yet
+    uint32_t count = 1;
+    while (count <= mPrefetchPages && count < mMaxPages) {
+        uint64_t next = static_cast<uint64_t>(base) + count * PAGE_SIZE;
+        if (next % PREFETCH_BOUNDARY == 0) {
+            break;
+        }
+        auto it = mPages.find(static_cast<uint32_t>(next));
+        if (it != mPages.end() && it->second.valid) {
+            break;
+        }
+        count++;
+    }
+
+    std::vector<uint8_t> buffer(count * PAGE_SIZE);
+    if (!mClient.read(base, buffer.data(), count * PAGE_SIZE)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        Page &page          = mPages[base + i * PAGE_SIZE];
+        const uint8_t *data = buffer.data() + i * PAGE_SIZE;
+        if (page.dirty.none()) {
+            memcpy(page.data.data(), data, PAGE_SIZE);
+        } else {
+            // pending writes win over the fetched data
+            for (uint32_t j = 0; j < PAGE_SIZE; j++) {
+                if (!page.dirty.test(j)) {
+                    page.data[j] = data[j];
+                }
+            }
+        }
+        page.valid   = true;
+        page.lastUse = ++mUseCounter;
+    }
+    mStats.fetchedPages += count;
+    mStats.prefetchedPages += count - 1;
+
+    evict(base, base + (count - 1) * PAGE_SIZE);
+    return true;
+}
+
+void RemoteMemory::evict(uint32_t keepFirst, uint32_t keepLast) {
+    while (mPages.size() > mMaxPages) {
+        auto victim = mPages.end();
+        for (auto it = mPages.begin(); it != mPages.end(); ++it) {
+            if (it->first >= keepFirst && it->first <= keepLast) {
+                continue;
+            }
+            if (victim == mPages.end() || it->second.lastUse < victim->second.lastUse) {
+                victim = it;
+            }
+        }
+        if (victim == mPages.end()) {
+            return;
+        }
+        // a page whose writes can't be sent stays, the cache grows instead of losing them
+        if (victim->second.dirty.any() && !flushRange(victim, std::next(victim))) {
+            return;
+        }
+        mPages.erase(victim);
+        mStats.evictedPages++;
+    }
+}
+
+bool RemoteMemory::flushRange(std::map<uint32_t, Page>::iterator first, std::map<uint32_t, Page>::iterator last) {
+    std::vector<uint8_t> run;
+    uint32_t runStart = 0;
+    bool res          = true;
+
+    auto sendRun = [&]() {
+        if (run.empty()) {
+            return;
+        }
+        if (mClient.write(runStart, run.data(), run.size())) {
+            mStats.flushedBytes += run.size();
+            mStats.flushedRuns++;
+        } else {
+            res = false;
+        }
+        run.clear();
+    };
+
+    for (auto it = first; it != last; ++it) {
+        const Page &page = it->second;
+        if (page.dirty.none()) {
+            continue;
+        }
+        for (uint32_t i = 0; i < PAGE_SIZE; i++) {
+            if (!page.dirty.test(i)) {
+                continue;
+            }
+            uint32_t address = it->first + i;
+            if (run.empty() || runStart + run.size() != address) {
+                sendRun();
+                runStart = address;
+            }
+            run.push_back(page.data[i]);
+        }
+    }
+    sendRun();
+
+    // on failure everything stays dirty, sending a run twice does no harm
+    if (res) {
+        for (auto it = first; it != last; ++it) {
+            it->second.dirty.reset();
+        }
+    }
+    return res;
+}
+
+uint64_t RemoteMemory::readBE(uint32_t address, size_t size) {
+    uint8_t buffer[8];
+    if (!read(address, buffer, size)) {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < size; i++) {
+        value = (value << 8) | buffer[i];
+    }
+    return value;
+}
+
+bool RemoteMemory::writeBE(uint32_t address, uint64_t value, size_t size) {
+    uint8_t buffer[8];
+    for (size_t i = 0; i < size; i++) {
+        buffer[size - 1 - i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+    return write(address, buffer, size);
+}
+
+} // namespace remotemem
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "WupClient.h"
+
+#include <array>
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+
+namespace remotemem {
+
+// Cached view of console memory. Reads are served from 4 KiB pages that are fetched on
+// demand together with the following pages, writes are kept in the cache until flush()
+// and then sent as few, large write commands.
+//
+// The cache knows nothing about the console changing memory by itself, call invalidate()
+// whenever cached data may be stale.
+class RemoteMemory {
+public:
+    static constexpr uint32_t PAGE_SIZE = 0x1000;
+
+    // prefetch never crosses this boundary, so it does not run off the end of a mapping
+    static constexpr uint32_t PREFETCH_BOUNDARY = 0x10000;
+
+    struct Stats {
+        uint64_t hits            = 0;
+        uint64_t misses          = 0;
+        uint64_t fetchedPages    = 0;
+        uint64_t prefetchedPages = 0;
+        uint64_t evictedPages    = 0;
+        uint64_t flushedBytes    = 0;
+        uint64_t flushedRuns     = 0;
+    };
+
+    explicit RemoteMemory(WupClient &client, size_t maxPages = 1024, uint32_t prefetchPages = 3);
+    ~RemoteMemory();
+
+    RemoteMemory(const RemoteMemory &)            = delete;
+    RemoteMemory &operator=(const RemoteMemory &) = delete;
+
+    bool read(uint32_t address, void *out, size_t size);
+    bool write(uint32_t address, const void *data, size_t size);
+
+    // big endian accessors, the console is big endian. Failed reads return 0.
+    uint8_t readU8(uint32_t address) { return static_cast<uint8_t>(readBE(address, 1)); }
+    uint16_t readU16(uint32_t address) { return static_cast<uint16_t>(readBE(address, 2)); }
+    uint32_t readU32(uint32_t address) { return static_cast<uint32_t>(readBE(address, 4)); }
+    uint64_t readU64(uint32_t address) { return readBE(address, 8); }
+    bool writeU8(uint32_t address, uint8_t value) { return writeBE(address, value, 1); }
+    bool writeU16(uint32_t address, uint16_t value) { return writeBE(address, value, 2); }
+    bool writeU32(uint32_t address, uint32_t value) { return writeBE(address, value, 4); }
+    bool writeU64(uint32_t address, uint64_t value) { return writeBE(address, value, 8); }
+
+    // Sends all pending writes, adjacent dirty bytes are merged even across pages.
+    bool flush();
+
+    // Drops cached data, pending writes are kept and still sent by flush().
+    void invalidate();
+    void invalidate(uint32_t address, size_t size);
+
+    void setPrefetchPages(uint32_t pages) { mPrefetchPages = pages; }
+    const Stats &stats() const { return mStats; }
+
+private:
+    struct Page {
+        std::array<uint8_t, PAGE_SIZE> data;
+        std::bitset<PAGE_SIZE> dirty;
+        bool valid       = false;
+        uint64_t lastUse = 0;
+    };
+
+    Page *lookup(uint32_t base, bool fetch);
+    bool fetch(uint32_t base);
+    void evict(uint32_t keepFirst, uint32_t keepLast);
+    void invalidatePages(std::map<uint32_t, Page>::iterator it, std::map<uint32_t, Page>::iterator last);
+    bool flushRange(std::map<uint32_t, Page>::iterator first, std::map<uint32_t, Page>::iterator last);
+
+    uint64_t readBE(uint32_t address, size_t size);
+    bool writeBE(uint32_t address, uint64_t value, size_t size);
+
+    WupClient &mClient;
+    std::map<uint32_t, Page> mPages;
+    size_t mMaxPages;
+    uint32_t mPrefetchPages;
+    uint64_t mUseCounter = 0;
+    Stats mStats;
+};
+
+} // namespace remotemem
@@ -0,0 +1,166 @@
+#include "WupClient.h"
+
+#include <arpa/inet.h>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace remotemem {
+
+namespace {
+    constexpr uint32_t CMD_WRITE       = 0;
+    constexpr uint32_t CMD_READ        = 1;
+    constexpr uint32_t CMD_STREAM_READ = 16;
+
+    constexpr int32_t ERROR_UNKNOWN_COMMAND = -2;
+} // namespace
+
+WupClient::~WupClient() {
+    disconnect();
+}
+
+bool WupClient::connect(const std::string &host, uint16_t port) {
+    disconnect();
+
+    addrinfo hints{};
+    hints.ai_family   = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *result = nullptr;
+    if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) {
+        return false;
+    }
+
+    for (addrinfo *ai = result; ai; ai = ai->ai_next) {
+        int fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) {
+            // every request waits for its reply, so don't let Nagle hold it back
+            int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            mSocket = fd;
+            break;
+        }
+        close(fd);
+    }
+    freeaddrinfo(result);
+
+    mStreamRead = true;
+    return mSocket >= 0;
+}
+
+void WupClient::disconnect() {
+    if (mSocket >= 0) {
+        close(mSocket);
+        mSocket = -1;
+    }
+}
+
+bool WupClient::read(uint32_t address, void *out, uint32_t size) {
+    auto *dst = static_cast<uint8_t *>(out);
+    while (size) {
+        if (mStreamRead) {
+            uint32_t chunk = size < MAX_STREAM_READ ? size : MAX_STREAM_READ;
+            if (request({CMD_STREAM_READ, address, chunk}, nullptr, 0, dst, chunk)) {
+                address += chunk;
+                dst += chunk;
+                size -= chunk;
+                continue;
+            }
+            if (mLastError != ERROR_UNKNOWN_COMMAND) {
+                return false;
+            }
+            // older wupserver, fall back to reads through the command buffer
+            mStreamRead = false;
+        }
+
+        uint32_t chunk = size < MAX_READ_SIZE ? size : MAX_READ_SIZE;
+        if (!request({CMD_READ, address, chunk}, nullptr, 0, dst, chunk)) {
+            return false;
+        }
+        address += chunk;
+        dst += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool WupClient::write(uint32_t address, const void *data, uint32_t size) {
+    auto *src = static_cast<const uint8_t *>(data);
+    while (size) {
+        uint32_t chunk = size < MAX_WRITE_SIZE ? size : MAX_WRITE_SIZE;
+        if (!request({CMD_WRITE, address}, src, chunk, nullptr, 0)) {
+            return false;
+        }
+        address += chunk;
+        src += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+bool WupClient::request(const std::vector<uint32_t> &header, const void *payload, uint32_t payloadSize, void *out, uint32_t outSize) {
+    if (mSocket < 0) {
+        return false;
+    }
+
+    // the whole request has to arrive in a single recv() on the server side
+    uint8_t buffer[COMMAND_BUFFER_SIZE];
+    size_t length = 0;
+    for (uint32_t word : header) {
+        uint32_t be = htonl(word);
+        memcpy(buffer + length, &be, 4);
+        length += 4;
+    }
+    memcpy(buffer + length, payload, payloadSize);
+    length += payloadSize;
+
+    mRoundTrips++;
+    uint32_t status;
+    if (!sendAll(buffer, length) || !recvAll(&status, 4)) {
+        disconnect();
+        return false;
+    }
+    mLastError = static_cast<int32_t>(ntohl(status));
+    if (mLastError != 0) {
+        return false;
+    }
+    if (outSize && !recvAll(out, outSize)) {
+        disconnect();
+        return false;
+    }
+    return true;
+}
+
+bool WupClient::sendAll(const void *data, size_t size) {
+    auto *src = static_cast<const uint8_t *>(data);
+    while (size) {
+        ssize_t res = send(mSocket, src, size, 0);
+        if (res <= 0) {
+            return false;
+        }
+        src += res;
+        size -= res;
+    }
+    return true;
+}
+
+bool WupClient::recvAll(void *data, size_t size) {
+    auto *dst = static_cast<uint8_t *>(data);
+    while (size) {
+        ssize_t res = recv(mSocket, dst, size, 0);
+        if (res <= 0) {
+            return false;
+        }
+        dst += res;
+        size -= res;
+    }
+    return true;
+}
+
+} // namespace remotemem
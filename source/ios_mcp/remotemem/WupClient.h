@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace remotemem {
+
+// Blocking connection to the wupserver running in ios_mcp (or to stand_in_server).
+// wupserver handles one command per recv(), so requests are never pipelined.
+class WupClient {
+public:
+    static constexpr uint32_t COMMAND_BUFFER_SIZE = 0x600;
+    static constexpr uint32_t MAX_READ_SIZE       = COMMAND_BUFFER_SIZE - 4;
+    static constexpr uint32_t MAX_WRITE_SIZE      = COMMAND_BUFFER_SIZE - 8;
+    static constexpr uint32_t MAX_STREAM_READ     = 0x10000;
+
+    WupClient() = default;
+    ~WupClient();
+
+    WupClient(const WupClient &)            = delete;
+    WupClient &operator=(const WupClient &) = delete;
+
+    bool connect(const std::string &host, uint16_t port = 1337);
+    void disconnect();
+
+    // Reads are split into stream reads, or into command buffer sized reads on
+    // servers without the stream read command. Writes are split into command buffer sized writes.
+    bool read(uint32_t address, void *out, uint32_t size);
+    bool write(uint32_t address, const void *data, uint32_t size);
+
+    uint64_t roundTrips() const { return mRoundTrips; }
+    int32_t lastError() const { return mLastError; }
+
+private:
+    bool request(const std::vector<uint32_t> &header, const void *payload, uint32_t payloadSize, void *out, uint32_t outSize);
+    bool sendAll(const void *data, size_t size);
+    bool recvAll(void *data, size_t size);
+
+    int mSocket             = -1;
+    bool mStreamRead        = true;
+    uint64_t mRoundTrips    = 0;
+    int32_t mLastError      = 0;
+};
+
+} // namespace remotemem
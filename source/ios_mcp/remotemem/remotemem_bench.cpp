@@ -0,0 +1,101 @@
+// Compares uncached WupClient access with RemoteMemory for a few typical tool access patterns.
+//
+// usage: remotemem_bench [host] [port] [base] [size]
+
+#include "RemoteMemory.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+
+using namespace remotemem;
+
+namespace {
+struct Workload {
+    const char *name;
+    std::function<bool(WupClient &)> direct;
+    std::function<bool(RemoteMemory &)> cached;
+};
+
+void run(const char *host, uint16_t port, const Workload &workload) {
+    for (int cached = 0; cached < 2; cached++) {
+        WupClient client;
+        if (!client.connect(host, port)) {
+            printf("failed to connect to %s:%u\n", host, port);
+            exit(1);
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        bool res;
+        RemoteMemory::Stats stats;
+        if (cached) {
+            RemoteMemory memory(client);
+            res = workload.cached(memory) && memory.flush();
+            stats = memory.stats();
+        } else {
+            res = workload.direct(client);
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        printf("%-24s %-8s %s %10lld us %8llu round trips", workload.name, cached ? "cached" : "direct", res ? "ok    " : "FAILED",
+               static_cast<long long>(us), static_cast<unsigned long long>(client.roundTrips()));
+        if (cached) {
+            printf("  (%llu hits, %llu misses, %llu prefetched)", static_cast<unsigned long long>(stats.hits),
+                   static_cast<unsigned long long>(stats.misses), static_cast<unsigned long long>(stats.prefetchedPages));
+        }
+        printf("\n");
+    }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    const char *host = argc > 1 ? argv[1] : "127.0.0.1";
+    uint16_t port    = argc > 2 ? static_cast<uint16_t>(strtoul(argv[2], nullptr, 0)) : 1337;
+    uint32_t base    = argc > 3 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 0)) : 0x10000000;
+    uint32_t size    = argc > 4 ? static_cast<uint32_t>(strtoul(argv[4], nullptr, 0)) : 0x40000;
+
+    // scattered u32 reads inside the region, e.g. following pointers through structures
+    std::vector<uint32_t> addresses(4096);
+    std::mt19937 rng(1234);
+    for (auto &a : addresses) {
+        a = base + (rng() % (size / 4)) * 4;
+    }
+
+    run(host, port, {"scattered u32 reads", [&](WupClient &c) {
+        uint32_t v;
+        for (uint32_t a : addresses) {
+            if (!c.read(a, &v, 4)) return false;
+        }
+        return true; }, [&](RemoteMemory &m) {
+        uint32_t v;
+        for (uint32_t a : addresses) {
+            if (!m.read(a, &v, 4)) return false;
+        }
+        return true; }});
+
+    run(host, port, {"sequential u32 scan", [&](WupClient &c) {
+        uint32_t v;
+        for (uint32_t a = base; a < base + size; a += 4) {
+            if (!c.read(a, &v, 4)) return false;
+        }
+        return true; }, [&](RemoteMemory &m) {
+        for (uint32_t a = base; a < base + size; a += 4) {
+            m.readU32(a);
+        }
+        return true; }});
+
+    run(host, port, {"sequential u32 writes", [&](WupClient &c) {
+        for (uint32_t a = base; a < base + size / 4; a += 4) {
+            if (!c.write(a, &a, 4)) return false;
+        }
+        return true; }, [&](RemoteMemory &m) {
+        for (uint32_t a = base; a < base + size / 4; a += 4) {
+            if (!m.write(a, &a, 4)) return false;
+        }
+        return true; }});
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+// Local stand-in for the wupserver in ios_mcp, serving a block of host memory with the
+// same protocol so tools using remotemem can be developed and benchmarked offline.
+//
+// usage: stand_in_server [port] [base] [size] [latency_us]
+
+#include <arpa/inet.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+constexpr uint32_t COMMAND_BUFFER_SIZE = 0x600;
+constexpr uint32_t STREAM_READ_MAX     = 0x10000;
+
+struct Memory {
+    uint32_t base;
+    std::vector<uint8_t> data;
+
+    uint8_t *at(uint32_t address, uint32_t size) {
+        if (address < base || static_cast<uint64_t>(address - base) + size > data.size()) {
+            return nullptr;
+        }
+        return data.data() + (address - base);
+    }
+};
+
+bool sendAll(int sock, const void *data, size_t size) {
+    auto *src = static_cast<const uint8_t *>(data);
+    while (size) {
+        ssize_t res = send(sock, src, size, 0);
+        if (res <= 0) {
+            return false;
+        }
+        src += res;
+        size -= res;
+    }
+    return true;
+}
+
+bool sendStatus(int sock, int32_t status) {
+    uint32_t be = htonl(static_cast<uint32_t>(status));
+    return sendAll(sock, &be, 4);
+}
+
+void handleClient(int sock, Memory &memory, uint32_t latencyUs) {
+    uint8_t buffer[COMMAND_BUFFER_SIZE];
+    uint64_t requests = 0;
+
+    while (true) {
+        // like wupserver, every recv() is one command
+        ssize_t length = recv(sock, buffer, sizeof(buffer), 0);
+        if (length <= 0) {
+            break;
+        }
+        requests++;
+        if (latencyUs) {
+            std::this_thread::sleep_for(std::chrono::microseconds(latencyUs));
+        }
+
+        uint32_t args[3] = {};
+        for (size_t i = 0; i < 3 && (i + 1) * 4 <= static_cast<size_t>(length); i++) {
+            memcpy(&args[i], buffer + i * 4, 4);
+            args[i] = ntohl(args[i]);
+        }
+
+        bool ok = true;
+        switch (args[0]) {
+            case 0: { // write [cmd_id][addr][data]
+                uint32_t size = length >= 8 ? length - 8 : 0;
+                uint8_t *dst  = length >= 8 ? memory.at(args[1], size) : nullptr;
+                if (!dst) {
+                    ok = sendStatus(sock, -1);
+                    break;
+                }
+                memcpy(dst, buffer + 8, size);
+                ok = sendStatus(sock, 0);
+                break;
+            }
+            case 1:    // read [cmd_id][addr][length]
+            case 16: { // stream read [cmd_id][addr][length]
+                uint32_t max       = args[0] == 1 ? COMMAND_BUFFER_SIZE - 4 : STREAM_READ_MAX;
+                const uint8_t *src = length >= 12 ? memory.at(args[1], args[2]) : nullptr;
+                if (length < 12 || args[2] > max) {
+                    ok = sendStatus(sock, -3);
+                } else if (!src) {
+                    ok = sendStatus(sock, -1);
+                } else {
+                    ok = sendStatus(sock, 0) && sendAll(sock, src, args[2]);
+                }
+                break;
+            }
+            default:
+                ok = sendStatus(sock, -2);
+                break;
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    printf("client disconnected after %llu requests\n", static_cast<unsigned long long>(requests));
+    close(sock);
+}
+} // namespace
+
+int main(int argc, char **argv) {
+    uint16_t port      = argc > 1 ? static_cast<uint16_t>(strtoul(argv[1], nullptr, 0)) : 1337;
+    uint32_t base      = argc > 2 ? static_cast<uint32_t>(strtoul(argv[2], nullptr, 0)) : 0x10000000;
+    uint32_t size      = argc > 3 ? static_cast<uint32_t>(strtoul(argv[3], nullptr, 0)) : 0x01000000;
+    uint32_t latencyUs = argc > 4 ? static_cast<uint32_t>(strtoul(argv[4], nullptr, 0)) : 0;
+
+    Memory memory{base, std::vector<uint8_t>(size)};
+    for (uint32_t i = 0; i < size; i++) {
+        memory.data[i] = static_cast<uint8_t>(((base + i) * 2654435761u) >> 24);
+    }
+
+    int server = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int one    = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(server, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 || listen(server, 1) < 0) {
+        perror("stand_in_server");
+        return 1;
+    }
+    printf("serving 0x%08X - 0x%08X on port %u\n", base, base + size, port);
+
+    // one client at a time, like wupserver
+    while (true) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) {
+            break;
+        }
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        handleClient(client, memory, latencyUs);
+    }
+
+    close(server);
+    return 0;
+}
@@ -0,0 +1,240 @@
+#include "benchmark.h"
+#include "fsa.h"
+#include "heap.h"
+#include "imports.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+#define BENCH_WORKER_STACK_SIZE 0x800
+#define BENCH_WORKER_PRIORITY   0x79 // above the calling server thread, see bench_run
+
+typedef struct BenchWorker {
+    const BenchParams *params;
+    int fsaFd;
+    int handle;
+    int queueId;
+    u32 index;
+    u32 *latencies;
+    u8 *data;
+    u8 *stack;
+    s32 result;
+    u32 ops;
+} BenchWorker;
+
+static u32 bench_offset(const BenchParams *p, u32 op) {
+    u32 block = op;
+    if (p->flags & BENCH_FLAG_RANDOM) {
+        block *= 0x9E3779B1;
+        block ^= block >> 15;
+        block *= 0x85EBCA77;
+        block ^= block >> 13;
+    }
+    return (block % (p->span / p->block_size)) * p->block_size;
+}
+
+static int bench_worker(void *arg) {
+    BenchWorker *w       = (BenchWorker *) arg;
+    const BenchParams *p = w->params;
+
+    // every worker issues every queue_depth-th operation, so queue_depth requests are in flight at once
+    for (u32 op = w->index; op < p->op_count; op += p->queue_depth) {
+        u32 offset = bench_offset(p, op);
+        u32 start  = timer_ticks();
+        int res;
+        if (p->flags & BENCH_FLAG_RAW) {
+            res = FSA_RawRead(w->fsaFd, w->data, BENCH_RAW_SECTOR_SIZE, p->block_size / BENCH_RAW_SECTOR_SIZE, p->raw_sector + offset / BENCH_RAW_SECTOR_SIZE, w->handle);
+        } else if (p->flags & BENCH_FLAG_WRITE) {
+            res = FSA_WriteFileWithPos(w->fsaFd, w->data, 1, p->block_size, offset, w->handle, FSA_READ_FLAG_READ_WITH_POS);
+        } else {
+            res = FSA_ReadFileWithPos(w->fsaFd, w->data, 1, p->block_size, offset, w->handle, FSA_READ_FLAG_READ_WITH_POS);
+        }
+        w->latencies[op] = timer_ticks() - start;
+
+        if (res < 0) {
+            w->result = res;
+            break;
+        }
+        w->ops++;
+    }
+
+    svcSendMessage(w->queueId, (u32) w, 0);
+    return 0;
+}
+
+// Opens the file or device. Files for write tests are created and filled up to span first,
+// read tests are limited to the size of the file.
+static int bench_open(int fsaFd, BenchParams *p, u8 *zeroBlock, int *handle) {
+    if (p->flags & BENCH_FLAG_RAW) {
+        return FSA_RawOpen(fsaFd, p->path, handle);
+    }
+
+    FSStat stat;
+    int res = FSA_OpenFile(fsaFd, p->path, (p->flags & BENCH_FLAG_WRITE) ? "r+" : "r", handle);
+    if (res >= 0) {
+        res = FSA_GetStatFile(fsaFd, *handle, &stat);
+        if (res < 0) {
+            FSA_CloseFile(fsaFd, *handle);
+        }
+    }
+
+    if (!(p->flags & BENCH_FLAG_WRITE)) {
+        if (res < 0) {
+            return res;
+        }
+        if (stat.size < p->span) {
+            p->span = stat.size - (stat.size % p->block_size);
+        }
+        if (p->span < p->block_size) {
+            FSA_CloseFile(fsaFd, *handle);
+            return IOS_ERROR_INVALID_SIZE;
+        }
+        return 0;
+    }
+
+    if (res >= 0 && stat.size >= p->span) {
+        return 0;
+    }
+    if (res >= 0) {
+        FSA_CloseFile(fsaFd, *handle);
+    }
+
+    res = FSA_OpenFileEx(fsaFd, p->path, "w", 0, 0, p->span, handle);
+    for (u32 written = 0; res >= 0 && written < p->span; written += p->block_size) {
+        res = FSA_WriteFile(fsaFd, zeroBlock, 1, p->block_size, *handle, 0);
+    }
+    return res;
+}
+
+static void bench_sort(u32 *values, u32 count) {
+    for (u32 gap = count / 2; gap > 0; gap /= 2) {
+        for (u32 i = gap; i < count; i++) {
+            u32 value = values[i];
+            u32 j     = i;
+            for (; j >= gap && values[j - gap] > value; j -= gap) {
+                values[j] = values[j - gap];
+            }
+            values[j] = value;
+        }
+    }
+}
+
+int bench_run(const BenchParams *params, BenchResult *out) {
+    BenchParams p;
+    BenchWorker workers[BENCH_MAX_QUEUE_DEPTH];
+    u32 messageQueue[BENCH_MAX_QUEUE_DEPTH];
+
+    memset(out, 0, sizeof(*out));
+    memset(workers, 0, sizeof(workers));
+    memcpy(&p, params, sizeof(p));
+    p.path[sizeof(p.path) - 1] = '\0';
+
+    if (p.queue_depth == 0 || p.queue_depth > BENCH_MAX_QUEUE_DEPTH || p.op_count == 0 || p.op_count > BENCH_MAX_OPS ||
+        p.block_size == 0 || p.span < p.block_size ||
+        ((p.flags & BENCH_FLAG_RAW) && ((p.flags & BENCH_FLAG_WRITE) || (p.block_size % BENCH_RAW_SECTOR_SIZE)))) {
+        return out->result = IOS_ERROR_INVALID_ARG;
+    }
+
+    u32 *latencies = (u32 *) heap_alloc(p.op_count * sizeof(u32));
+    int res        = latencies ? 0 : IOS_ERROR_UNKNOWN;
+    for (u32 i = 0; res >= 0 && i < p.queue_depth; i++) {
+        workers[i].data  = (u8 *) heap_alloc_align(p.block_size, 0x40);
+        workers[i].stack = (u8 *) heap_alloc_align(BENCH_WORKER_STACK_SIZE, 0x20);
+        if (!workers[i].data || !workers[i].stack) {
+            res = IOS_ERROR_UNKNOWN;
+        } else {
+            memset(workers[i].data, 0x00, p.block_size);
+        }
+    }
+
+    int fsaFd  = -1;
+    int handle = -1;
+    if (res >= 0) {
+        fsaFd = svcOpen("/dev/fsa", 0);
+        res   = fsaFd;
+    }
+    if (res >= 0) {
+        res = bench_open(fsaFd, &p, workers[0].data, &handle);
+        if (res < 0) {
+            handle = -1;
+        }
+    }
+
+    int queueId = -1;
+    if (res >= 0) {
+        queueId = svcCreateMessageQueue(messageQueue, p.queue_depth);
+        res     = queueId;
+    }
+
+    if (res >= 0) {
+        u32 started = 0;
+        u32 start   = timer_ticks();
+
+        // the workers run at a higher priority than the calling thread, so they are done
+        // with their stacks by the time their completion message is received here
+        for (u32 i = 0; i < p.queue_depth; i++) {
+            BenchWorker *w = &workers[i];
+            w->params      = &p;
+            w->fsaFd       = fsaFd;
+            w->handle      = handle;
+            w->queueId     = queueId;
+            w->index       = i;
+            w->latencies   = latencies;
+
+            int threadId = svcCreateThread(bench_worker, w, (u32 *) (w->stack + BENCH_WORKER_STACK_SIZE), BENCH_WORKER_STACK_SIZE, BENCH_WORKER_PRIORITY, 1);
+            if (threadId < 0) {
+                res = threadId;
+                break;
+            }
+            svcStartThread(threadId);
+            started++;
+        }
+
+        for (u32 i = 0; i < started; i++) {
+            BenchWorker *w;
+            svcReceiveMessage(queueId, (ipcmessage **) &w, 0);
+            if (w->result < 0 && res >= 0) {
+                res = w->result;
+            }
+            out->ops += w->ops;
+        }
+
+        out->elapsed_us = ticks_to_us(timer_ticks() - start);
+        out->bytes      = (u64) out->ops * p.block_size;
+        if (out->elapsed_us) {
+            out->kib_per_sec = (u32) ((out->bytes * 15625 / 16) / out->elapsed_us);
+            out->iops        = (u32) ((u64) out->ops * 1000000 / out->elapsed_us);
+        }
+
+        if (res >= 0 && out->ops) {
+            bench_sort(latencies, out->ops);
+            out->lat_min_us = ticks_to_us(latencies[0]);
+            out->lat_p50_us = ticks_to_us(latencies[out->ops / 2]);
+            out->lat_p90_us = ticks_to_us(latencies[(out->ops * 90) / 100]);
+            out->lat_p99_us = ticks_to_us(latencies[(out->ops * 99) / 100]);
+            out->lat_max_us = ticks_to_us(latencies[out->ops - 1]);
+        }
+        svcDestroyMessageQueue(queueId);
+    }
+
+    if (handle >= 0) {
+        if (p.flags & BENCH_FLAG_RAW) {
+            FSA_RawClose(fsaFd, handle);
+        } else {
+            FSA_CloseFile(fsaFd, handle);
+        }
+    }
+    if (fsaFd >= 0) {
+        svcClose(fsaFd);
+    }
+    for (u32 i = 0; i < p.queue_depth; i++) {
+        if (workers[i].data) heap_free(workers[i].data);
+        if (workers[i].stack) heap_free(workers[i].stack);
+    }
+    if (latencies) {
+        heap_free(latencies);
+    }
+
+    out->result = res < 0 ? res : 0;
+    return out->result;
+}
@@ -0,0 +1,40 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include "types.h"
+
+#define BENCH_FLAG_WRITE       0x01 // write instead of read
+#define BENCH_FLAG_RANDOM      0x02 // random instead of sequential offsets
+#define BENCH_FLAG_RAW         0x04 // FSA_RawRead on a device instead of a file
+
+#define BENCH_MAX_QUEUE_DEPTH  8
+#define BENCH_MAX_OPS          0x4000
+#define BENCH_RAW_SECTOR_SIZE  0x200
+
+typedef struct BenchParams {
+    u32 flags;
+    u32 block_size;  // bytes per operation
+    u32 queue_depth; // operations in flight, 1 - BENCH_MAX_QUEUE_DEPTH
+    u32 op_count;    // number of operations, 1 - BENCH_MAX_OPS
+    u32 span;        // size of the region that is exercised in bytes
+    u32 raw_sector;  // raw mode: first sector of the region
+    char path[0x100]; // file path, or device path like "/dev/sdcard01" in raw mode
+} BenchParams;
+
+typedef struct BenchResult {
+    s32 result; // 0 or the first failing FSA result
+    u32 ops;    // completed operations
+    u64 bytes;
+    u32 elapsed_us;
+    u32 kib_per_sec;
+    u32 iops;
+    u32 lat_min_us;
+    u32 lat_p50_us;
+    u32 lat_p90_us;
+    u32 lat_p99_us;
+    u32 lat_max_us;
+} BenchResult;
+
+int bench_run(const BenchParams *params, BenchResult *out);
+
+#endif
@@ -0,0 +1,437 @@
+#include "filecache.h"
+#include "fsa.h"
+#include "heap.h"
+#include "imports.h"
+#include "statcache.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+typedef struct {
+    int inUse;
+    int fd;
+    int handle;
+    u32 pathHash; // statcache_file_hash of the handle, 0 = unknown
+    u32 lastUse;
+    u32 pos;        // file position as seen by the client
+    int posValid;   // pos is known, otherwise it is queried with FSA_GetPosFile
+    int posStale;   // reads were served from memory, the FSA file position is behind pos
+    u32 next;       // where the next read starts if the access is sequential
+    u32 sequential; // reads in a row that started at next
+    u8 *block;
+    u32 blockStart;
+    u32 blockLength; // less than the block size at the end of the file
+    u8 *wbuf;        // write-behind buffer, the FSA file position stays at the start of the buffered data
+    u32 wbufSize;
+    u32 wbufLength;
+    u32 wbufFlags;
+    u32 wbufTime;    // timer_ticks of the oldest buffered write
+    int writeError;  // first failed flush, returned by the next FILECACHE_SYNC_FLUSH
+} FileCacheEntry;
+
+static FileCacheEntry entries[FILECACHE_MAX_ENTRIES];
+static FileCacheStats stats;
+static u32 useCounter;
+static u32 bufferedEntries;
+static mutex_t cacheMutex;
+
+static u32 wakeupQueue[1];
+static int wakeupQueueId;
+
+static void filecache_free_block(FileCacheEntry *e) {
+    if (e->block) {
+        heap_free(e->block);
+    }
+    e->block       = NULL;
+    e->blockLength = 0;
+}
+
+// Drops the read-ahead data of the handles of the file with pathHash, all of them for 0.
+static void filecache_drop_file(u32 pathHash) {
+    for (u32 i = 0; i < FILECACHE_MAX_ENTRIES; i++) {
+        FileCacheEntry *e = &entries[i];
+        if (e->inUse && e->block && (!pathHash || !e->pathHash || e->pathHash == pathHash)) {
+            filecache_free_block(e);
+            stats.drops++;
+        }
+    }
+}
+
+static void filecache_flush(FileCacheEntry *e) {
+    if (!e->wbufLength) {
+        return;
+    }
+    int res = FSA_WriteFile(e->fd, e->wbuf, 1, e->wbufLength, e->handle, e->wbufFlags);
+    if (res != (int) e->wbufLength) {
+        // the FSA file position is unknown after a short or failed write
+        e->posValid = 0;
+        if (!e->writeError) {
+            e->writeError = res < 0 ? res : (int) IOS_ERROR_UNKNOWN;
+        }
+    }
+    e->wbufLength = 0;
+    e->posStale   = 0;
+    bufferedEntries--;
+    stats.write_flushes++;
+
+    // the data only reaches the file now, other handles may have read ahead and stats may have been
+    // fetched in the meantime
+    filecache_drop_file(e->pathHash);
+    statcache_file_changed(e->fd, e->handle, 0);
+}
+
+static void filecache_free_wbuf(FileCacheEntry *e) {
+    if (e->wbuf) {
+        heap_free(e->wbuf);
+    }
+    e->wbuf     = NULL;
+    e->wbufSize = 0;
+}
+
+static int filecache_sync_entry(FileCacheEntry *e, u32 flags) {
+    filecache_flush(e);
+    if (e->posStale) {
+        FSA_SetPosFile(e->fd, e->handle, e->pos);
+        e->posStale = 0;
+    }
+    if (flags & FILECACHE_SYNC_SEEK) {
+        e->posValid = 0;
+    }
+
+    int res = 0;
+    if (flags & (FILECACHE_SYNC_FLUSH | FILECACHE_SYNC_CLOSE)) {
+        res           = e->writeError;
+        e->writeError = 0;
+    }
+    if (flags & (FILECACHE_SYNC_DROP | FILECACHE_SYNC_CLOSE)) {
+        filecache_free_block(e);
+    }
+    // files with a write buffer keep their entry until they are closed
+    if ((flags & FILECACHE_SYNC_CLOSE) || ((flags & FILECACHE_SYNC_DROP) && !e->wbuf)) {
+        filecache_free_wbuf(e);
+        memset(e, 0, sizeof(FileCacheEntry));
+    }
+    return res;
+}
+
+static FileCacheEntry *filecache_find(int fd, int fileHandle) {
+    for (u32 i = 0; i < FILECACHE_MAX_ENTRIES; i++) {
+        if (entries[i].inUse && entries[i].fd == fd && entries[i].handle == fileHandle) {
+            return &entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Returns a new entry for the file. Only read-ahead entries are replaced, the least recently used one
+// if there is no free entry or, for the read-ahead cache, if it already has as many files as configured.
+static FileCacheEntry *filecache_alloc(int fd, int fileHandle, int forWrite) {
+    FileCacheEntry *unused = NULL;
+    FileCacheEntry *oldest = NULL;
+    u32 readEntries        = 0;
+    for (u32 i = 0; i < FILECACHE_MAX_ENTRIES; i++) {
+        FileCacheEntry *e = &entries[i];
+        if (!e->inUse) {
+            if (!unused) {
+                unused = e;
+            }
+        } else if (!e->wbuf) {
+            readEntries++;
+            if (!oldest || e->lastUse < oldest->lastUse) {
+                oldest = e;
+            }
+        }
+    }
+
+    FileCacheEntry *e = unused;
+    if (oldest && (!unused || (!forWrite && readEntries >= stats.entries))) {
+        filecache_sync_entry(oldest, FILECACHE_SYNC_CLOSE);
+        e = oldest;
+    }
+    if (e) {
+        e->inUse    = 1;
+        e->fd       = fd;
+        e->handle   = fileHandle;
+        e->pathHash = statcache_file_hash(fd, fileHandle);
+    }
+    return e;
+}
+
+static int filecache_update_pos(FileCacheEntry *e) {
+    if (!e->posValid) {
+        if (FSA_GetPosFile(e->fd, e->handle, &e->pos) < 0) {
+            return 0;
+        }
+        e->posValid = 1;
+        e->posStale = 0;
+    }
+    return 1;
+}
+
+static int filecache_fetch(FileCacheEntry *e, u32 start) {
+    // the position has to be known before the fetch, it may move the FSA file position
+    if (!filecache_update_pos(e)) {
+        return 0;
+    }
+    if (!e->block) {
+        e->block = (u8 *) heap_alloc_align(stats.block_size, 0x40);
+        if (!e->block) {
+            return 0;
+        }
+    }
+
+    e->blockStart  = start & ~(stats.block_size - 1);
+    e->posStale    = 1;
+    int res        = FSA_ReadFileWithPos(e->fd, e->block, 1, stats.block_size, e->blockStart, e->handle, FSA_READ_FLAG_READ_WITH_POS);
+    e->blockLength = res < 0 ? 0 : res;
+
+    stats.fetches++;
+    stats.bytes_fetched += e->blockLength;
+    return start - e->blockStart < e->blockLength;
+}
+
+// Copies length bytes at start from the cached block, with fetch set missing blocks are read ahead.
+// Returns 0 if not all of the data could be copied, e.g. because the read goes past the end of the file.
+static int filecache_copy(FileCacheEntry *e, u32 start, u8 *data, u32 length, int fetch) {
+    while (length) {
+        if (start < e->blockStart || start - e->blockStart >= e->blockLength) {
+            if (!fetch || !filecache_fetch(e, start)) {
+                return 0;
+            }
+        }
+        u32 offset = start - e->blockStart;
+        u32 chunk  = e->blockLength - offset;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(data, e->block + offset, chunk);
+        data += chunk;
+        start += chunk;
+        length -= chunk;
+    }
+    return 1;
+}
+
+int filecache_read(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags) {
+    u32 length = size * cnt;
+
+    // the lock is held while blocks are fetched, requests that go to FSA directly are sent without it
+    mutex_lock(&cacheMutex);
+    FileCacheEntry *e = filecache_find(fd, fileHandle);
+    if (e) {
+        filecache_flush(e);
+    } else if (stats.block_size) {
+        e = filecache_alloc(fd, fileHandle, 0);
+    }
+
+    if (e && stats.block_size && (pos != FILECACHE_CURRENT_POS || filecache_update_pos(e))) {
+        u32 start     = pos == FILECACHE_CURRENT_POS ? e->pos : pos;
+        e->lastUse    = ++useCounter;
+        e->sequential = start == e->next ? e->sequential + 1 : 0;
+        e->next       = start + length;
+
+        // large reads go to FSA directly, they gain nothing from the copy
+        if (length && length < stats.block_size && filecache_copy(e, start, data, length, e->sequential >= FILECACHE_SEQUENTIAL_READS)) {
+            if (pos == FILECACHE_CURRENT_POS) {
+                e->pos += length;
+                e->posStale = 1;
+            }
+            stats.hits++;
+            mutex_unlock(&cacheMutex);
+            return cnt;
+        }
+    }
+    if (e && pos == FILECACHE_CURRENT_POS) {
+        filecache_sync_entry(e, FILECACHE_SYNC_SEEK);
+    }
+    if (stats.block_size) {
+        stats.misses++;
+    }
+    mutex_unlock(&cacheMutex);
+
+    if (pos == FILECACHE_CURRENT_POS) {
+        return FSA_ReadFile(fd, data, size, cnt, fileHandle, flags);
+    }
+    return FSA_ReadFileWithPos(fd, data, size, cnt, pos, fileHandle, flags);
+}
+
+int filecache_write(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags) {
+    u32 length = size * cnt;
+
+    mutex_lock(&cacheMutex);
+    FileCacheEntry *e = filecache_find(fd, fileHandle);
+    if (e && e->wbuf && pos == FILECACHE_CURRENT_POS && length && length <= e->wbufSize) {
+        filecache_free_block(e);
+        if (e->wbufLength && (flags != e->wbufFlags || e->wbufLength + length > e->wbufSize)) {
+            filecache_flush(e);
+        }
+
+        // the buffered data is written where the file position is when the first write arrives
+        int buffered = e->wbufLength || filecache_update_pos(e);
+        if (buffered && !e->wbufLength) {
+            filecache_sync_entry(e, 0);
+            e->wbufFlags = flags;
+            e->wbufTime  = timer_ticks();
+            if (bufferedEntries++ == 0) {
+                svcSendMessage(wakeupQueueId, 0, 1);
+            }
+        }
+
+        if (buffered) {
+            memcpy(e->wbuf + e->wbufLength, data, length);
+            e->wbufLength += length;
+            e->pos += length;
+            stats.writes_buffered++;
+            if (e->wbufLength == e->wbufSize) {
+                filecache_flush(e);
+            }
+            mutex_unlock(&cacheMutex);
+            return cnt;
+        }
+    }
+    if (e) {
+        filecache_sync_entry(e, FILECACHE_SYNC_DROP);
+    }
+    mutex_unlock(&cacheMutex);
+
+    if (pos == FILECACHE_CURRENT_POS) {
+        return FSA_WriteFile(fd, data, size, cnt, fileHandle, flags);
+    }
+    return FSA_WriteFileWithPos(fd, data, size, cnt, pos, fileHandle, flags);
+}
+
+int filecache_sync(int fd, int fileHandle, u32 flags) {
+    int res = 0;
+    mutex_lock(&cacheMutex);
+    FileCacheEntry *e = filecache_find(fd, fileHandle);
+    if (e) {
+        if ((flags & (FILECACHE_SYNC_DROP | FILECACHE_SYNC_CLOSE)) && e->block) {
+            stats.drops++;
+        }
+        res = filecache_sync_entry(e, flags);
+    }
+    mutex_unlock(&cacheMutex);
+    return res;
+}
+
+int filecache_set_write_buffer(int fd, int fileHandle, u32 size) {
+    if (size > FILECACHE_MAX_WRITE_BUFFER) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+
+    int res = 0;
+    mutex_lock(&cacheMutex);
+    FileCacheEntry *e = filecache_find(fd, fileHandle);
+    if (e) {
+        filecache_sync_entry(e, 0);
+        filecache_free_wbuf(e);
+    } else if (size) {
+        e = filecache_alloc(fd, fileHandle, 1);
+        if (!e) {
+            res = IOS_ERROR_UNKNOWN;
+        }
+    }
+
+    if (e && size) {
+        e->wbuf = (u8 *) heap_alloc_align(size, 0x40);
+        if (e->wbuf) {
+            e->wbufSize = size;
+        } else {
+            res = IOS_ERROR_UNKNOWN;
+        }
+    }
+    if (e && !e->wbuf && !e->block) {
+        memset(e, 0, sizeof(FileCacheEntry));
+    }
+    mutex_unlock(&cacheMutex);
+    return res;
+}
+
+void filecache_file_changed(int fd, int fileHandle) {
+    mutex_lock(&cacheMutex);
+    FileCacheEntry *e = filecache_find(fd, fileHandle);
+    filecache_drop_file(e ? e->pathHash : statcache_file_hash(fd, fileHandle));
+    mutex_unlock(&cacheMutex);
+}
+
+void filecache_open_file(char *path, char *mode) {
+    if (statcache_mode_writes(mode)) {
+        filecache_invalidate_path(path);
+    }
+}
+
+void filecache_invalidate_path(char *path) {
+    mutex_lock(&cacheMutex);
+    filecache_drop_file(statcache_path_hash(path));
+    mutex_unlock(&cacheMutex);
+}
+
+void filecache_invalidate_all(void) {
+    mutex_lock(&cacheMutex);
+    filecache_drop_file(0);
+    mutex_unlock(&cacheMutex);
+}
+
+// Flushes write buffers that hold data for longer than FILECACHE_WRITE_DELAY, sleeps while there are none.
+static int filecache_thread(void *arg) {
+    while (1) {
+        if (!bufferedEntries) {
+            ipcmessage *dummy;
+            svcReceiveMessage(wakeupQueueId, &dummy, 0);
+            continue;
+        }
+        usleep(FILECACHE_WRITE_DELAY * 1000 / 4);
+
+        mutex_lock(&cacheMutex);
+        u32 now = timer_ticks();
+        for (u32 i = 0; i < FILECACHE_MAX_ENTRIES; i++) {
+            FileCacheEntry *e = &entries[i];
+            if (e->wbufLength && now - e->wbufTime >= FILECACHE_WRITE_DELAY * (LT_TIMER_TICKS_PER_SEC / 1000)) {
+                filecache_flush(e);
+            }
+        }
+        mutex_unlock(&cacheMutex);
+    }
+    return 0;
+}
+
+void filecache_init(void) {
+    mutex_init(&cacheMutex);
+    stats.block_size = FILECACHE_BLOCK_SIZE;
+    stats.entries    = FILECACHE_ENTRIES > FILECACHE_MAX_ENTRIES ? FILECACHE_MAX_ENTRIES : FILECACHE_ENTRIES;
+
+    wakeupQueueId = svcCreateMessageQueue(wakeupQueue, 1);
+
+    u8 *stack = (u8 *) heap_alloc_align(FILECACHE_THREAD_STACK_SIZE, 0x20);
+    if (!stack) {
+        return;
+    }
+    int threadId = svcCreateThread(filecache_thread, 0, (u32 *) (stack + FILECACHE_THREAD_STACK_SIZE), FILECACHE_THREAD_STACK_SIZE, 0x78, 1);
+    if (threadId >= 0)
+        svcStartThread(threadId);
+}
+
+int filecache_configure(u32 block_size, u32 entries_count) {
+    if (block_size && (block_size < 0x200 || (block_size & (block_size - 1)) || entries_count == 0 || entries_count > FILECACHE_MAX_ENTRIES)) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+
+    // write buffers are kept, only the read-ahead data is dropped
+    mutex_lock(&cacheMutex);
+    for (u32 i = 0; i < FILECACHE_MAX_ENTRIES; i++) {
+        if (entries[i].inUse) {
+            filecache_sync_entry(&entries[i], FILECACHE_SYNC_DROP);
+        }
+    }
+    memset(&stats, 0, sizeof(stats));
+    stats.block_size = block_size;
+    stats.entries    = block_size ? entries_count : 0;
+    mutex_unlock(&cacheMutex);
+    return 0;
+}
+
+void filecache_get_stats(FileCacheStats *out) {
+    mutex_lock(&cacheMutex);
+    memcpy(out, &stats, sizeof(FileCacheStats));
+    mutex_unlock(&cacheMutex);
+}
@@ -0,0 +1,124 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include "fsa.h"
+#include "types.h"
+
+#define FILECACHE_MAX_ENTRIES 8
+#ifndef FILECACHE_BLOCK_SIZE
+#define FILECACHE_BLOCK_SIZE 0x8000 // default, 0 disables the cache until it is configured
+#endif
+#ifndef FILECACHE_ENTRIES
+#define FILECACHE_ENTRIES 4
+#endif
+#define FILECACHE_SEQUENTIAL_READS 2 // reads in a row that start where the last one ended before blocks are fetched
+
+#define FILECACHE_MAX_WRITE_BUFFER 0x40000
+#ifndef FILECACHE_WRITE_DELAY
+#define FILECACHE_WRITE_DELAY 500 // ms, buffered writes are flushed after at most this long
+#endif
+
+#define FILECACHE_CURRENT_POS      0xFFFFFFFF // position for IOCTL_FSA_READFILE/WRITEFILE, the file position is used and advanced
+
+#define FILECACHE_SYNC_SEEK        0x01 // the request moves the file position, it has to be queried again
+#define FILECACHE_SYNC_DROP        0x02 // the request changes the file, the cached data is dropped
+#define FILECACHE_SYNC_FLUSH       0x04 // the client flushes the file, a failed flush of buffered writes is returned
+#define FILECACHE_SYNC_CLOSE       0x08 // the file is closed, the write buffer is released as well
+
+typedef struct FileCacheStats {
+    u32 block_size;
+    u32 entries;
+    u32 hits;          // reads served from memory
+    u32 misses;        // reads that went to FSA
+    u32 fetches;       // blocks read ahead
+    u32 bytes_fetched;
+    u32 drops;           // cached files dropped because of a write, truncate or close
+    u32 writes_buffered; // writes that went to a write buffer
+    u32 write_flushes;   // FSA writes of buffered data
+} FileCacheStats;
+
+#ifdef MOCHA_FSA_CACHE
+
+#define FILECACHE_THREAD_STACK_SIZE 0x800
+// the flush thread and the read-ahead blocks of the default configuration, write buffers are set up
+// by clients and come from the shared heap when they don't fit
+#define FILECACHE_HEAP_SIZE (HEAP_BLOCK_SIZE(FILECACHE_THREAD_STACK_SIZE, 0x20) + FILECACHE_ENTRIES * HEAP_BLOCK_SIZE(FILECACHE_BLOCK_SIZE, 0x40))
+
+void filecache_init(void);
+
+// Drops the read-ahead data and switches to up to entries cached files of block_size bytes each.
+// block_size has to be a power of two of at least 0x200, 0 disables the cache.
+int filecache_configure(u32 block_size, u32 entries);
+
+void filecache_get_stats(FileCacheStats *stats);
+
+// Replaces FSA_ReadFile (pos = FILECACHE_CURRENT_POS) and FSA_ReadFileWithPos, with the same result.
+int filecache_read(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags);
+
+// Replaces FSA_WriteFile and FSA_WriteFileWithPos. Writes at the file position on a file with a write
+// buffer are collected and written at once when the buffer is full, after FILECACHE_WRITE_DELAY or
+// when another request on the file arrives. The result is then the count the write would have had.
+int filecache_write(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags);
+
+// Has to be called before any other request on a file handle. Buffered writes are flushed, and as reads
+// served from memory don't move the position of the FSA file it is brought up to date. flags are
+// FILECACHE_SYNC_*, with FILECACHE_SYNC_FLUSH or FILECACHE_SYNC_CLOSE a failed flush is returned.
+int filecache_sync(int fd, int fileHandle, u32 flags);
+
+// Enables write-behind on a file with a buffer of size bytes, 0 flushes it and turns it off again.
+int filecache_set_write_buffer(int fd, int fileHandle, u32 size);
+
+// Read-ahead data is kept per file handle, but a file can be changed through any handle or by path.
+// These drop the data of every handle the file is open with, or of all handles if the path of the
+// file is not known. filecache_file_changed is for writes through fileHandle, filecache_open_file
+// for opens that may truncate the file and filecache_invalidate_path for removes and renames.
+void filecache_file_changed(int fd, int fileHandle);
+
+void filecache_open_file(char *path, char *mode);
+
+void filecache_invalidate_path(char *path);
+
+// Drops all read-ahead data, for volume-wide changes and changes to whole trees.
+void filecache_invalidate_all(void);
+
+#else
+
+#define FILECACHE_HEAP_SIZE 0
+
+// without the cache every request goes straight to FSA
+static inline void filecache_init(void) {
+}
+
+static inline int filecache_read(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags) {
+    if (pos == FILECACHE_CURRENT_POS) {
+        return FSA_ReadFile(fd, data, size, cnt, fileHandle, flags);
+    }
+    return FSA_ReadFileWithPos(fd, data, size, cnt, pos, fileHandle, flags);
+}
+
+static inline int filecache_write(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags) {
+    if (pos == FILECACHE_CURRENT_POS) {
+        return FSA_WriteFile(fd, data, size, cnt, fileHandle, flags);
+    }
+    return FSA_WriteFileWithPos(fd, data, size, cnt, pos, fileHandle, flags);
+}
+
+static inline int filecache_sync(int fd, int fileHandle, u32 flags) {
+    return 0;
+}
+
+static inline void filecache_file_changed(int fd, int fileHandle) {
+}
+
+static inline void filecache_open_file(char *path, char *mode) {
+}
+
+static inline void filecache_invalidate_path(char *path) {
+}
+
+static inline void filecache_invalidate_all(void) {
+}
+
+#endif
+
+#endif
@@ -1,18 +1,20 @@
 #include "fsa.h"
 #include "imports.h"
+#include "slab.h"
 #include "svc.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define FSA_IOBUF_SIZE 0x828
+
+// Iobufs come from the slab and are not cleared, every request sets the input fields it uses.
 static void *allocIobuf() {
-    void *ptr = svcAlloc(0xCAFF, 0x828);
-    memset(ptr, 0x00, 0x828);
-    return ptr;
+    return slab_alloc(FSA_IOBUF_SIZE);
 }
 
 static void freeIobuf(void *ptr) {
-    svcFree(0xCAFF, ptr);
+    slab_free(ptr);
 }
 
 static int _ioctl_fd_path_internal(int fd, int ioctl_num, int num_args, char *path, u32 arg1, u32 arg2, u32 arg3, u32 arg4, u32 *out_data, u32 out_data_size) {
@@ -20,6 +22,11 @@ static int _ioctl_fd_path_internal(int fd, int ioctl_num, int num_args, char *pa
     u32 *inbuf  = (u32 *) iobuf;
     u32 *outbuf = (u32 *) &iobuf[0x520];
 
+    // strncpy pads the path with zeros, the argument words that are not passed have to be cleared
+    inbuf[0x00]  = 0;
+    iobuf[0x283] = 0;
+    memset(&inbuf[0x284 / 4], 0, 0x10);
+
     switch (num_args) {
         case 5:
             inbuf[0x290 / 4] = arg4;
@@ -46,6 +53,8 @@ static int _ioctl_fd_handle_internal(int fd, int ioctl_num, int num_args, int ha
     u32 *inbuf  = (u32 *) iobuf;
     u32 *outbuf = (u32 *) &iobuf[0x520];
 
+    memset(inbuf, 0, 0x18);
+
     switch (num_args) {
         case 5:
             inbuf[0x05] = arg4;
@@ -86,70 +95,95 @@ static int _ioctl_fd_handle_internal(int fd, int ioctl_num, int num_args, int ha
 #define dispatch_ioctl(fd, ioctl_num, ...)      GET_MACRO(__VA_ARGS__, NULL, NULL, dispatch_ioctl_arg5,     dispatch_ioctl_arg4,     dispatch_ioctl_arg3,     dispatch_ioctl_arg2,     dispatch_ioctl_arg1)(fd, ioctl_num, __VA_ARGS__)
 // clang-format on
 
-int _FSA_ReadWriteFileWithPos(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags, bool read) {
-    u8 *iobuf      = allocIobuf();
-    u32 *outbuf    = (u32 *) &iobuf[0x520];
-    iovec_s *iovec = (iovec_s *) &iobuf[0x7C0];
-    u32 *inbuf     = (u32 *) iobuf;
+static u8 *_FSA_AllocFileIobuf(u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags) {
+    u8 *iobuf  = allocIobuf();
+    u32 *inbuf = (u32 *) iobuf;
 
+    inbuf[0x00 / 4] = 0;
+    inbuf[0x04 / 4] = 0;
     inbuf[0x08 / 4] = size;
     inbuf[0x0C / 4] = cnt;
     inbuf[0x10 / 4] = pos;
     inbuf[0x14 / 4] = fileHandle;
     inbuf[0x18 / 4] = flags;
-
-    iovec[0].ptr = inbuf;
-    iovec[0].len = 0x520;
-
-    iovec[1].ptr = data;
-    iovec[1].len = size * cnt;
-
-    iovec[2].ptr = outbuf;
-    iovec[2].len = 0x293;
-
-    int ret;
-    if (read) {
-        ret = svcIoctlv(fd, 0x0F, 1, 2, iovec);
-    } else {
-        ret = svcIoctlv(fd, 0x10, 2, 1, iovec);
-    }
-
-    freeIobuf(iobuf);
-    return ret;
+    return iobuf;
 }
 
-int _FSA_RawReadWrite(int fd, void *data, u32 size_bytes, u32 cnt, u64 blocks_offset, int device_handle, bool read) {
-    u8 *iobuf      = allocIobuf();
-    u32 *inbuf     = (u32 *) iobuf;
-    u32 *outbuf    = (u32 *) &iobuf[0x520];
-    iovec_s *iovec = (iovec_s *) &iobuf[0x7C0];
+static u8 *_FSA_AllocRawIobuf(u32 size_bytes, u32 cnt, u64 blocks_offset, int device_handle) {
+    u8 *iobuf  = allocIobuf();
+    u32 *inbuf = (u32 *) iobuf;
 
+    inbuf[0x00 / 4] = 0;
+    inbuf[0x04 / 4] = 0;
     inbuf[0x08 / 4] = (blocks_offset >> 32);
     inbuf[0x0C / 4] = (blocks_offset & 0xFFFFFFFF);
     inbuf[0x10 / 4] = cnt;
     inbuf[0x14 / 4] = size_bytes;
     inbuf[0x18 / 4] = device_handle;
+    return iobuf;
+}
 
-    iovec[0].ptr = inbuf;
+// reads have one input and two output vectors, writes two inputs and one output
+static int _FSA_IoctlvReadWrite(int fd, u32 request, u8 *iobuf, void *data, u32 length, bool read, int queueId, FSAAsyncRequest *async) {
+    iovec_s *iovec = (iovec_s *) &iobuf[0x7C0];
+
+    memset(iovec, 0, sizeof(iovec_s) * 3);
+
+    iovec[0].ptr = iobuf;
     iovec[0].len = 0x520;
 
     iovec[1].ptr = data;
-    iovec[1].len = size_bytes * cnt;
+    iovec[1].len = length;
 
-    iovec[2].ptr = outbuf;
+    iovec[2].ptr = &iobuf[0x520];
     iovec[2].len = 0x293;
 
-    int ret;
-    if (read) {
-        ret = svcIoctlv(fd, 0x6B, 1, 2, iovec);
-    } else {
-        ret = svcIoctlv(fd, 0x6C, 2, 1, iovec);
+    if (async) {
+        async->iobuf = iobuf;
+        return svcIoctlvAsync(fd, request, read ? 1 : 2, read ? 2 : 1, iovec, queueId, &async->reply);
     }
+    return svcIoctlv(fd, request, read ? 1 : 2, read ? 2 : 1, iovec);
+}
+
+int _FSA_ReadWriteFileWithPos(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags, bool read) {
+    u8 *iobuf = _FSA_AllocFileIobuf(size, cnt, pos, fileHandle, flags);
+    int ret   = _FSA_IoctlvReadWrite(fd, read ? 0x0F : 0x10, iobuf, data, size * cnt, read, 0, NULL);
 
     freeIobuf(iobuf);
     return ret;
 }
 
+int _FSA_RawReadWrite(int fd, void *data, u32 size_bytes, u32 cnt, u64 blocks_offset, int device_handle, bool read) {
+    u8 *iobuf = _FSA_AllocRawIobuf(size_bytes, cnt, blocks_offset, device_handle);
+    int ret   = _FSA_IoctlvReadWrite(fd, read ? 0x6B : 0x6C, iobuf, data, size_bytes * cnt, read, 0, NULL);
+
+    freeIobuf(iobuf);
+    return ret;
+}
+
+int FSA_ReadWriteFileWithPosAsync(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags, bool read, int queueId, FSAAsyncRequest *request) {
+    u8 *iobuf = _FSA_AllocFileIobuf(size, cnt, pos, fileHandle, flags);
+    int ret   = _FSA_IoctlvReadWrite(fd, read ? 0x0F : 0x10, iobuf, data, size * cnt, read, queueId, request);
+    if (ret < 0) {
+        freeIobuf(iobuf);
+    }
+    return ret;
+}
+
+int FSA_RawReadWriteAsync(int fd, void *data, u32 size_bytes, u32 cnt, u64 blocks_offset, int device_handle, bool read, int queueId, FSAAsyncRequest *request) {
+    u8 *iobuf = _FSA_AllocRawIobuf(size_bytes, cnt, blocks_offset, device_handle);
+    int ret   = _FSA_IoctlvReadWrite(fd, read ? 0x6B : 0x6C, iobuf, data, size_bytes * cnt, read, queueId, request);
+    if (ret < 0) {
+        freeIobuf(iobuf);
+    }
+    return ret;
+}
+
+int FSA_FinishAsync(FSAAsyncRequest *request) {
+    freeIobuf(request->iobuf);
+    return request->reply.result;
+}
+
 int FSA_Mount(int fd, char *device_path, char *volume_path, u32 flags, char *arg_string, int arg_string_len) {
     u8 *iobuf      = allocIobuf();
     u8 *inbuf8     = iobuf;
@@ -158,8 +192,12 @@ int FSA_Mount(int fd, char *device_path, char *volume_path, u32 flags, char *arg
     u32 *inbuf     = (u32 *) inbuf8;
     u32 *outbuf    = (u32 *) outbuf8;
 
+    memset(iovec, 0, sizeof(iovec_s) * 3);
+    inbuf[0x00 / 4] = 0;
     strncpy((char *) &inbuf8[0x04], device_path, 0x27F);
     strncpy((char *) &inbuf8[0x284], volume_path, 0x27F);
+    inbuf8[0x283]    = 0;
+    inbuf8[0x503]    = 0;
     inbuf[0x504 / 4] = (u32) flags;
     inbuf[0x508 / 4] = (u32) arg_string_len;
 
@@ -279,8 +317,11 @@ int FSA_Rename(int fd, char *old_path, char *new_path) {
     u32 *inbuf  = (u32 *) iobuf;
     u32 *outbuf = (u32 *) &iobuf[0x520];
 
+    inbuf[0x00] = 0;
     strncpy((char *) &inbuf[0x01], old_path, 0x27F);
     strncpy((char *) &inbuf[0x284 / 4], new_path, 0x27F);
+    iobuf[0x283] = 0;
+    iobuf[0x503] = 0;
 
     int ret = svcIoctl(fd, 0x09, inbuf, 0x520, outbuf, 0x293);
 
@@ -322,8 +363,10 @@ int FSA_OpenFileEx(int fd, char *path, char *mode, u32 flags, int create_mode, u
     u32 *inbuf  = (u32 *) iobuf;
     u32 *outbuf = (u32 *) &iobuf[0x520];
 
+    inbuf[0x00] = 0;
     strncpy((char *) &inbuf[0x01], path, 0x27F);
     strncpy((char *) &inbuf[0xA1], mode, 0x10);
+    iobuf[0x283] = 0;
     inbuf[0x294 / 4] = flags;
     inbuf[0x298 / 4] = create_mode;
     inbuf[0x29C / 4] = create_alloc_size;
@@ -380,7 +423,8 @@ int FSA_GetCwd(int fd, char *out_data, int output_size) {
     u32 *inbuf  = (u32 *) iobuf;
     u32 *outbuf = (u32 *) &iobuf[0x520];
 
-    int ret = svcIoctl(fd, 0x06, inbuf, 0x520, outbuf, 0x293);
+    inbuf[0x00] = 0;
+    int ret     = svcIoctl(fd, 0x06, inbuf, 0x520, outbuf, 0x293);
 
     if (output_size > 0x27F) {
         output_size = 0x27F;
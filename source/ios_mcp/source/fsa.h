@@ -1,6 +1,7 @@
 #ifndef FSA_H
 #define FSA_H
 
+#include "ipc_types.h"
 #include "types.h"
 #include <assert.h>
 
@@ -74,6 +75,17 @@ int FSA_RollbackQuotaForce(int fd, char *quota_path);
 int FSA_RegisterFlushQuota(int fd, char *quota_path);
 int FSA_FlushMultiQuota(int fd, char *quota_path);
 
+#define FSA_STATUS_BUSY              -0x30002
+#define FSA_STATUS_CANCELLED         -0x30003
+#define FSA_STATUS_END_OF_DIRECTORY  -0x30004
+#define FSA_STATUS_ALREADY_EXISTS    -0x30016
+#define FSA_STATUS_NOT_FOUND         -0x30017
+
+#define FSA_STAT_FLAG_DIRECTORY      0x80000000 // FSStat flags
+#define FSA_OPEN_FLAG_PREALLOC_SIZE  0x02       // flags of FSA_OpenFileEx, allocate create_alloc_size bytes up front
+
+#define FSA_READ_FLAG_READ_WITH_POS  0x01 // flags of FSA_ReadFileWithPos, use the position instead of the file position
+
 int FSA_OpenFile(int fd, char *path, char *mode, int *outHandle);
 int FSA_OpenFileEx(int fd, char *path, char *mode, u32 flags, int create_mode, u32 create_alloc_size, int *outHandle);
 int FSA_ReadFile(int fd, void *data, u32 size, u32 cnt, int fileHandle, u32 flags);
@@ -101,4 +113,16 @@ int FSA_RawRead(int fd, void *data, u32 size_bytes, u32 cnt, u64 sector_offset,
 int FSA_RawWrite(int fd, void *data, u32 size_bytes, u32 cnt, u64 sector_offset, int device_handle);
 int FSA_RawClose(int fd, int device_handle);
 
+typedef struct FSAAsyncRequest {
+    ipcmessage reply; // filled in and sent to the queue by the kernel once the request is done, must stay first
+    u8 *iobuf;
+    void *userdata;
+} FSAAsyncRequest;
+
+// Like FSA_ReadFileWithPos/FSA_WriteFileWithPos and FSA_RawRead/FSA_RawWrite, but they return as soon as the
+// request is queued. When the completion arrives at queueId, FSA_FinishAsync returns the result and frees the buffers.
+int FSA_ReadWriteFileWithPosAsync(int fd, void *data, u32 size, u32 cnt, u32 pos, int fileHandle, u32 flags, bool read, int queueId, FSAAsyncRequest *request);
+int FSA_RawReadWriteAsync(int fd, void *data, u32 size_bytes, u32 cnt, u64 blocks_offset, int device_handle, bool read, int queueId, FSAAsyncRequest *request);
+int FSA_FinishAsync(FSAAsyncRequest *request);
+
 #endif
@@ -0,0 +1,498 @@
+#include "fsa_tree.h"
+#include "filecache.h"
+#include "fsa.h"
+#include "heap.h"
+#include "imports.h"
+#include "statcache.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+#define TREE_VISIT_FILE  0
+#define TREE_VISIT_ENTER 1 // before the entries of a directory
+#define TREE_VISIT_LEAVE 2 // after the entries of a directory
+
+// stat is NULL for the directory the walk started at
+typedef int (*TreeVisitor)(void *arg, char *path, u32 rootLength, FSStat *stat, u32 event);
+
+typedef struct {
+    int fd;
+    u32 removed;
+    int dirResult; // last failed removal of a directory
+} FSATreeRemove;
+
+typedef struct {
+    int fd;
+    u32 flags;
+    char src[FSA_TREE_MAX_PATH];
+    char dst[FSA_TREE_MAX_PATH];
+    u32 dstLength;
+    u8 *buffers[2];
+    int queueId;
+} FSATreeCopy;
+static_assert(sizeof(FSATreeCopy) <= FSA_TREE_JOB_SIZE, "FSA_TREE_JOB_SIZE is too small");
+
+static FSATreeCopy *copyJob;
+static FSACopyStatus copyStatus;
+static volatile int copyCancel;
+static u32 copyStart;
+static mutex_t treeMutex;
+
+static u32 jobQueue[1];
+static int jobQueueId;
+static u32 readQueue[1];
+
+// Walks the tree below path depth first. path is extended in place and has to hold FSA_TREE_MAX_PATH bytes.
+static int tree_walk(int fd, char *path, TreeVisitor visit, void *arg) {
+    int handles[FSA_TREE_MAX_DEPTH];
+    u32 lengths[FSA_TREE_MAX_DEPTH];
+    FSDirectory dir;
+    u32 rootLength = strlen(path);
+    u32 depth      = 0;
+
+    int res = visit(arg, path, rootLength, NULL, TREE_VISIT_ENTER);
+    if (res >= 0) {
+        res = FSA_OpenDir(fd, path, &handles[0]);
+    }
+    if (res < 0) {
+        return res;
+    }
+    lengths[depth++] = rootLength;
+
+    while (depth) {
+        u32 length   = lengths[depth - 1];
+        path[length] = '\0';
+
+        res = FSA_ReadDir(fd, handles[depth - 1], &dir);
+        if (res == FSA_STATUS_END_OF_DIRECTORY) {
+            FSA_CloseDir(fd, handles[--depth]);
+            res = visit(arg, path, rootLength, NULL, TREE_VISIT_LEAVE);
+            if (res < 0) {
+                break;
+            }
+            continue;
+        }
+        if (res < 0) {
+            break;
+        }
+
+        dir.name[sizeof(dir.name) - 1] = '\0';
+        u32 nameLength                 = strlen(dir.name);
+        if (length + 1 + nameLength >= FSA_TREE_MAX_PATH) {
+            res = IOS_ERROR_INVALID_SIZE;
+            break;
+        }
+        path[length] = '/';
+        memcpy(path + length + 1, dir.name, nameLength + 1);
+
+        if (!(dir.info.flags & FSA_STAT_FLAG_DIRECTORY)) {
+            res = visit(arg, path, rootLength, &dir.info, TREE_VISIT_FILE);
+            if (res < 0) {
+                break;
+            }
+            continue;
+        }
+
+        if (depth == FSA_TREE_MAX_DEPTH) {
+            res = IOS_ERROR_INVALID_SIZE;
+            break;
+        }
+        res = visit(arg, path, rootLength, &dir.info, TREE_VISIT_ENTER);
+        if (res >= 0) {
+            res = FSA_OpenDir(fd, path, &handles[depth]);
+        }
+        if (res < 0) {
+            break;
+        }
+        lengths[depth++] = length + 1 + nameLength;
+    }
+
+    while (depth) {
+        FSA_CloseDir(fd, handles[--depth]);
+    }
+    return res < 0 ? res : 0;
+}
+
+// The next block is read in the background while the current one is written.
+static int tree_copy_data(FSATreeCopy *c, int srcHandle, int dstHandle, u32 size) {
+    FSAAsyncRequest request;
+    u32 pos     = 0;
+    u32 current = 0;
+    int pending = 0;
+    int res     = 0;
+
+    if (size) {
+        u32 length = size < FSA_TREE_BUFFER_SIZE ? size : FSA_TREE_BUFFER_SIZE;
+        res        = FSA_ReadWriteFileWithPosAsync(c->fd, c->buffers[0], 1, length, 0, srcHandle, FSA_READ_FLAG_READ_WITH_POS, true, c->queueId, &request);
+        pending    = res >= 0;
+    }
+
+    while (pending) {
+        ipcmessage *reply;
+        svcReceiveMessage(c->queueId, &reply, 0);
+        int length = FSA_FinishAsync(&request);
+        pending    = 0;
+        if (length <= 0) {
+            // the file got shorter while it was copied
+            res = length;
+            break;
+        }
+
+        pos += length;
+        if (pos < size && !copyCancel) {
+            u32 next = size - pos < FSA_TREE_BUFFER_SIZE ? size - pos : FSA_TREE_BUFFER_SIZE;
+            res      = FSA_ReadWriteFileWithPosAsync(c->fd, c->buffers[current ^ 1], 1, next, pos, srcHandle, FSA_READ_FLAG_READ_WITH_POS, true, c->queueId, &request);
+            pending  = res >= 0;
+        }
+
+        int written = FSA_WriteFile(c->fd, c->buffers[current], 1, length, dstHandle, 0);
+        if (res >= 0 && written != length) {
+            res = written < 0 ? written : (int) IOS_ERROR_UNKNOWN;
+        }
+        if (res >= 0 && copyCancel) {
+            res = FSA_STATUS_CANCELLED;
+        }
+        if (res < 0) {
+            break;
+        }
+
+        current ^= 1;
+        // the status is read by fsa_tree_copy_status, a u64 is not written at once
+        mutex_lock(&treeMutex);
+        copyStatus.bytes += length;
+        copyStatus.current_done = pos;
+        copyStatus.elapsed_ms   = ticks_to_us(timer_ticks() - copyStart) / 1000;
+        mutex_unlock(&treeMutex);
+    }
+
+    // the buffer of a read that is still in flight can't be released before it is done
+    if (pending) {
+        ipcmessage *reply;
+        svcReceiveMessage(c->queueId, &reply, 0);
+        FSA_FinishAsync(&request);
+    }
+    return res < 0 ? res : 0;
+}
+
+static int tree_copy_file(FSATreeCopy *c, char *src, char *dst) {
+    FSStat stat;
+    int srcHandle;
+    int dstHandle;
+
+    int res = FSA_OpenFile(c->fd, src, "r", &srcHandle);
+    if (res < 0) {
+        return res;
+    }
+    res = FSA_GetStatFile(c->fd, srcHandle, &stat);
+    if (res >= 0) {
+        res = FSA_OpenFileEx(c->fd, dst, "w", FSA_OPEN_FLAG_PREALLOC_SIZE, 0x666, stat.size, &dstHandle);
+    }
+    if (res >= 0) {
+        mutex_lock(&treeMutex);
+        copyStatus.current_size = stat.size;
+        copyStatus.current_done = 0;
+        mutex_unlock(&treeMutex);
+
+        res         = tree_copy_data(c, srcHandle, dstHandle, stat.size);
+        int closed  = FSA_CloseFile(c->fd, dstHandle);
+        if (res >= 0) {
+            res = closed;
+        }
+    }
+    FSA_CloseFile(c->fd, srcHandle);
+
+    if (res >= 0) {
+        mutex_lock(&treeMutex);
+        copyStatus.files++;
+        mutex_unlock(&treeMutex);
+    }
+    return res;
+}
+
+static int tree_copy_visit(void *arg, char *path, u32 rootLength, FSStat *stat, u32 event) {
+    FSATreeCopy *c = (FSATreeCopy *) arg;
+    u32 length     = strlen(path + rootLength);
+    if (c->dstLength + length >= FSA_TREE_MAX_PATH) {
+        return IOS_ERROR_INVALID_SIZE;
+    }
+    memcpy(c->dst + c->dstLength, path + rootLength, length + 1);
+
+    if (copyCancel) {
+        return FSA_STATUS_CANCELLED;
+    }
+    if (event == TREE_VISIT_FILE) {
+        return tree_copy_file(c, path, c->dst);
+    }
+    if (event == TREE_VISIT_ENTER) {
+        int res = FSA_MakeDir(c->fd, c->dst, 0x666);
+        if (res == FSA_STATUS_ALREADY_EXISTS) {
+            return 0;
+        }
+        if (res >= 0) {
+            mutex_lock(&treeMutex);
+            copyStatus.dirs++;
+            mutex_unlock(&treeMutex);
+        }
+        return res;
+    }
+    return 0;
+}
+
+static int tree_copy(FSATreeCopy *c) {
+    FSStat stat;
+    int res = FSA_GetStat(c->fd, c->src, &stat);
+    if (res < 0) {
+        return res;
+    }
+    if (!(stat.flags & FSA_STAT_FLAG_DIRECTORY)) {
+        return tree_copy_file(c, c->src, c->dst);
+    }
+    if (!(c->flags & FSA_COPY_FLAG_RECURSIVE)) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+    return tree_walk(c->fd, c->src, tree_copy_visit, c);
+}
+
+static int fsa_tree_thread(void *arg) {
+    while (1) {
+        ipcmessage *dummy;
+        svcReceiveMessage(jobQueueId, &dummy, 0);
+
+        FSATreeCopy *c = copyJob;
+        c->fd          = svcOpen("/dev/fsa", 0);
+        int res        = c->fd;
+        if (c->fd >= 0) {
+            res = tree_copy(c);
+            svcClose(c->fd);
+        }
+        c->dst[c->dstLength] = '\0';
+        statcache_invalidate_path(c->dst);
+        filecache_invalidate_all();
+
+        mutex_lock(&treeMutex);
+        heap_free(c->buffers[0]);
+        heap_free(c->buffers[1]);
+        copyStatus.elapsed_ms = ticks_to_us(timer_ticks() - copyStart) / 1000;
+        copyStatus.result     = res < 0 ? res : 0;
+        copyStatus.state      = FSA_COPY_STATE_DONE;
+        mutex_unlock(&treeMutex);
+    }
+    return 0;
+}
+
+void fsa_tree_init(void) {
+    mutex_init(&treeMutex);
+    jobQueueId = svcCreateMessageQueue(jobQueue, 1);
+
+    copyJob   = (FSATreeCopy *) heap_alloc(sizeof(FSATreeCopy));
+    u8 *stack = (u8 *) heap_alloc_align(FSA_TREE_THREAD_STACK_SIZE, 0x20);
+    if (!copyJob || !stack) {
+        copyJob = NULL;
+        return;
+    }
+    copyJob->queueId = svcCreateMessageQueue(readQueue, 1);
+
+    int threadId = svcCreateThread(fsa_tree_thread, 0, (u32 *) (stack + FSA_TREE_THREAD_STACK_SIZE), FSA_TREE_THREAD_STACK_SIZE, 0x78, 1);
+    if (threadId >= 0)
+        svcStartThread(threadId);
+}
+
+int fsa_tree_copy_start(const char *src, const char *dst, u32 flags) {
+    if (!copyJob) {
+        return IOS_ERROR_UNKNOWN;
+    }
+    if (src[0] != '/' || dst[0] != '/' || strlen(src) >= FSA_TREE_MAX_PATH || strlen(dst) >= FSA_TREE_MAX_PATH) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+
+    mutex_lock(&treeMutex);
+    if (copyStatus.state == FSA_COPY_STATE_RUNNING) {
+        mutex_unlock(&treeMutex);
+        return FSA_STATUS_BUSY;
+    }
+
+    FSATreeCopy *c = copyJob;
+    c->buffers[0]  = (u8 *) heap_alloc_align(FSA_TREE_BUFFER_SIZE, 0x40);
+    c->buffers[1]  = (u8 *) heap_alloc_align(FSA_TREE_BUFFER_SIZE, 0x40);
+    if (!c->buffers[0] || !c->buffers[1]) {
+        if (c->buffers[0]) heap_free(c->buffers[0]);
+        if (c->buffers[1]) heap_free(c->buffers[1]);
+        mutex_unlock(&treeMutex);
+        return IOS_ERROR_UNKNOWN;
+    }
+
+    strncpy(c->src, src, FSA_TREE_MAX_PATH - 1);
+    strncpy(c->dst, dst, FSA_TREE_MAX_PATH - 1);
+    c->src[FSA_TREE_MAX_PATH - 1] = '\0';
+    c->dst[FSA_TREE_MAX_PATH - 1] = '\0';
+    c->dstLength                  = strlen(c->dst);
+    c->flags                      = flags;
+
+    memset(&copyStatus, 0, sizeof(copyStatus));
+    copyStatus.state = FSA_COPY_STATE_RUNNING;
+    copyCancel       = 0;
+    copyStart        = timer_ticks();
+    mutex_unlock(&treeMutex);
+
+    svcSendMessage(jobQueueId, 0, 0);
+    return 0;
+}
+
+void fsa_tree_copy_status(FSACopyStatus *status) {
+    mutex_lock(&treeMutex);
+    memcpy(status, &copyStatus, sizeof(FSACopyStatus));
+    mutex_unlock(&treeMutex);
+}
+
+void fsa_tree_copy_cancel(void) {
+    copyCancel = 1;
+}
+
+// Only the mount point can be flushed, like /vol/external01 for everything below it.
+static int tree_flush_volume(int fd, char *path) {
+    u32 i       = 0;
+    u32 slashes = 0;
+    for (; path[i]; i++) {
+        if (path[i] == '/' && ++slashes == 3) {
+            break;
+        }
+    }
+    char c  = path[i];
+    path[i] = '\0';
+    int res = FSA_FlushVolume(fd, path);
+    path[i] = c;
+    return res;
+}
+
+// tree_walk extends the path in place, so it works on a copy with room for that
+static char *tree_copy_path(const char *path) {
+    char *buffer = (char *) heap_alloc(FSA_TREE_MAX_PATH);
+    if (buffer) {
+        strncpy(buffer, path, FSA_TREE_MAX_PATH - 1);
+        buffer[FSA_TREE_MAX_PATH - 1] = '\0';
+    }
+    return buffer;
+}
+
+static int tree_remove_visit(void *arg, char *path, u32 rootLength, FSStat *stat, u32 event) {
+    FSATreeRemove *r = (FSATreeRemove *) arg;
+    if (event == TREE_VISIT_ENTER) {
+        return 0;
+    }
+
+    int res = FSA_Remove(r->fd, path);
+    if (res >= 0) {
+        r->removed++;
+        return 0;
+    }
+    // a directory that is not empty yet is retried in the next pass
+    if (event == TREE_VISIT_LEAVE) {
+        r->dirResult = res;
+        return 0;
+    }
+    return res;
+}
+
+int fsa_tree_remove(int fd, const char *path) {
+    FSATreeRemove r = {fd, 0, 0};
+    FSStat stat;
+
+    if (path[0] != '/' || strlen(path) >= FSA_TREE_MAX_PATH) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+    char *buffer = tree_copy_path(path);
+    if (!buffer) {
+        return IOS_ERROR_UNKNOWN;
+    }
+    u32 length = strlen(buffer);
+
+    int res = FSA_GetStat(fd, buffer, &stat);
+    if (res >= 0 && !(stat.flags & FSA_STAT_FLAG_DIRECTORY)) {
+        res = FSA_Remove(fd, buffer);
+        if (res >= 0) {
+            r.removed++;
+        }
+    } else if (res >= 0) {
+        // ReadDir can skip an entry when the one before it was removed, so this repeats as long as
+        // there is progress and the directory is still there
+        u32 removed;
+        do {
+            removed     = r.removed;
+            r.dirResult = 0;
+            res         = tree_walk(fd, buffer, tree_remove_visit, &r);
+
+            buffer[length] = '\0';
+        } while (res >= 0 && r.dirResult < 0 && r.removed != removed);
+        if (res >= 0) {
+            res = r.dirResult;
+        }
+    }
+
+    if (r.removed) {
+        statcache_invalidate_path(buffer);
+        filecache_invalidate_all();
+        int flushed = tree_flush_volume(fd, buffer);
+        if (res >= 0) {
+            res = flushed;
+        }
+    }
+    heap_free(buffer);
+    return res < 0 ? res : (int) r.removed;
+}
+
+int fsa_tree_make_dirs(int fd, const char *path, u32 mode) {
+    if (path[0] != '/' || strlen(path) >= FSA_TREE_MAX_PATH) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+    char *buffer = tree_copy_path(path);
+    if (!buffer) {
+        return IOS_ERROR_UNKNOWN;
+    }
+    u32 length = strlen(buffer);
+    while (length > 1 && buffer[length - 1] == '/') {
+        buffer[--length] = '\0';
+    }
+
+    // go up to the deepest directory that exists, the separators in between are cut off on the way
+    u32 end = length;
+    int res;
+    while ((res = FSA_MakeDir(fd, buffer, mode)) == FSA_STATUS_NOT_FOUND) {
+        while (end > 1 && buffer[end - 1] != '/') {
+            end--;
+        }
+        if (end <= 1) {
+            break;
+        }
+        buffer[--end] = '\0';
+    }
+
+    // then back down, one directory at a time
+    u32 created = 0;
+    u32 top     = end;
+    if (res >= 0) {
+        created++;
+    }
+    while ((res >= 0 || res == FSA_STATUS_ALREADY_EXISTS) && end < length) {
+        buffer[end] = '/';
+        end += 1 + strlen(buffer + end + 1);
+        res = FSA_MakeDir(fd, buffer, mode);
+        if (res >= 0 && !created++) {
+            top = end;
+        }
+    }
+    if (res == FSA_STATUS_ALREADY_EXISTS) {
+        res = 0;
+    }
+
+    if (created) {
+        // the first created directory covers the stats of everything below it
+        buffer[top] = '\0';
+        statcache_invalidate_path(buffer);
+        int flushed = tree_flush_volume(fd, buffer);
+        if (res >= 0) {
+            res = flushed;
+        }
+    }
+    heap_free(buffer);
+    return res < 0 ? res : (int) created;
+}
@@ -0,0 +1,58 @@
+#ifndef FSA_TREE_H
+#define FSA_TREE_H
+
+#include "types.h"
+
+#define FSA_TREE_MAX_PATH    0x280
+#define FSA_TREE_MAX_DEPTH   16
+#ifndef FSA_TREE_BUFFER_SIZE
+#define FSA_TREE_BUFFER_SIZE 0x40000 // two of them, one is read while the other one is written
+#endif
+
+#define FSA_TREE_THREAD_STACK_SIZE 0x1000
+#define FSA_TREE_JOB_SIZE          (2 * FSA_TREE_MAX_PATH + 0x20) // at least the size of the copy job in fsa_tree.c
+#ifdef MOCHA_FSA_TOOLS
+// the copy job, its thread and the buffers of the running copy
+#define FSA_TREE_HEAP_SIZE \
+    (HEAP_BLOCK_SIZE(FSA_TREE_JOB_SIZE, 0x10) + HEAP_BLOCK_SIZE(FSA_TREE_THREAD_STACK_SIZE, 0x20) + 2 * HEAP_BLOCK_SIZE(FSA_TREE_BUFFER_SIZE, 0x40))
+#else
+#define FSA_TREE_HEAP_SIZE 0
+#endif
+
+#define FSA_COPY_FLAG_RECURSIVE 0x01 // copy directories with everything in them
+
+#define FSA_COPY_STATE_IDLE     0
+#define FSA_COPY_STATE_RUNNING  1
+#define FSA_COPY_STATE_DONE     2
+
+typedef struct FSACopyStatus {
+    u32 state;
+    s32 result; // 0 or the first failing FSA result once the copy is done
+    u32 files;  // files copied so far
+    u32 dirs;   // directories created so far
+    u64 bytes;
+    u32 current_size; // size of the file that is copied right now
+    u32 current_done;
+    u32 elapsed_ms;
+} FSACopyStatus;
+
+void fsa_tree_init(void);
+
+// Starts copying src to dst in the background, both have to be absolute paths.
+// Only one copy runs at a time, FSA_STATUS_BUSY is returned while one is running.
+int fsa_tree_copy_start(const char *src, const char *dst, u32 flags);
+
+void fsa_tree_copy_status(FSACopyStatus *status);
+
+// The running copy stops after the current block with FSA_STATUS_CANCELLED.
+void fsa_tree_copy_cancel(void);
+
+// Removes path and everything below it, the volume is flushed once at the end.
+// Returns the number of removed files and directories or the first failing FSA result.
+int fsa_tree_remove(int fd, const char *path);
+
+// Creates path and all missing directories above it, existing ones are not an error.
+// Returns the number of created directories or the first failing FSA result.
+int fsa_tree_make_dirs(int fd, const char *path, u32 mode);
+
+#endif
@@ -0,0 +1,344 @@
+#include "hash.h"
+#include "fsa.h"
+#include "heap.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+typedef struct {
+    u32 state[8];
+    u64 length;
+    u32 used;
+    u8 block[64];
+} ShaContext;
+
+typedef void (*ShaTransform)(u32 *state, const u8 *block);
+
+typedef struct {
+    const HashParams *params;
+    int fsaFd;
+    int handle;
+    int queueId;
+    u8 *buffers[2];
+    u32 *crcTable;
+} HashJob;
+
+// hashes run one at a time, the private heap has room for the buffers of one
+static mutex_t hashMutex;
+
+static const u32 sha256K[64] = {
+        0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+        0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+        0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+        0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+        0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+        0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+        0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+        0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2,
+};
+
+static inline u32 rol32(u32 value, u32 bits) {
+    return (value << bits) | (value >> (32 - bits));
+}
+
+static inline u32 ror32(u32 value, u32 bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static inline u32 load_be32(const u8 *p) {
+    return ((u32) p[0] << 24) | ((u32) p[1] << 16) | ((u32) p[2] << 8) | p[3];
+}
+
+static inline void store_be32(u8 *p, u32 value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+static void sha1_transform(u32 *state, const u8 *block) {
+    u32 w[16];
+    u32 a = state[0], b = state[1], c = state[2], d = state[3], e = state[4];
+
+    for (u32 i = 0; i < 80; i++) {
+        if (i < 16) {
+            w[i] = load_be32(block + i * 4);
+        } else {
+            w[i & 15] = rol32(w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15], 1);
+        }
+
+        u32 f;
+        if (i < 20) {
+            f = ((b & c) | (~b & d)) + 0x5A827999;
+        } else if (i < 40) {
+            f = (b ^ c ^ d) + 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = ((b & c) | (b & d) | (c & d)) + 0x8F1BBCDC;
+        } else {
+            f = (b ^ c ^ d) + 0xCA62C1D6;
+        }
+
+        u32 t = rol32(a, 5) + f + e + w[i & 15];
+        e     = d;
+        d     = c;
+        c     = rol32(b, 30);
+        b     = a;
+        a     = t;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+}
+
+static void sha256_transform(u32 *state, const u8 *block) {
+    u32 w[16];
+    u32 v[8];
+    memcpy(v, state, sizeof(v));
+
+    for (u32 i = 0; i < 64; i++) {
+        if (i < 16) {
+            w[i] = load_be32(block + i * 4);
+        } else {
+            u32 w15   = w[(i + 1) & 15];
+            u32 w2    = w[(i + 14) & 15];
+            u32 s0    = ror32(w15, 7) ^ ror32(w15, 18) ^ (w15 >> 3);
+            u32 s1    = ror32(w2, 17) ^ ror32(w2, 19) ^ (w2 >> 10);
+            w[i & 15] = w[i & 15] + s0 + w[(i + 9) & 15] + s1;
+        }
+
+        u32 t1 = v[7] + (ror32(v[4], 6) ^ ror32(v[4], 11) ^ ror32(v[4], 25)) + ((v[4] & v[5]) ^ (~v[4] & v[6])) + sha256K[i] + w[i & 15];
+        u32 t2 = (ror32(v[0], 2) ^ ror32(v[0], 13) ^ ror32(v[0], 22)) + ((v[0] & v[1]) ^ (v[0] & v[2]) ^ (v[1] & v[2]));
+        v[7]   = v[6];
+        v[6]   = v[5];
+        v[5]   = v[4];
+        v[4]   = v[3] + t1;
+        v[3]   = v[2];
+        v[2]   = v[1];
+        v[1]   = v[0];
+        v[0]   = t1 + t2;
+    }
+
+    for (u32 i = 0; i < 8; i++) {
+        state[i] += v[i];
+    }
+}
+
+// SHA-1 and SHA-256 share the block handling and the padding
+static void sha_update(ShaContext *ctx, const u8 *data, u32 size, ShaTransform transform) {
+    ctx->length += size;
+    if (ctx->used) {
+        u32 chunk = 64 - ctx->used < size ? 64 - ctx->used : size;
+        memcpy(ctx->block + ctx->used, data, chunk);
+        ctx->used += chunk;
+        data += chunk;
+        size -= chunk;
+        if (ctx->used < 64) {
+            return;
+        }
+        transform(ctx->state, ctx->block);
+        ctx->used = 0;
+    }
+    for (; size >= 64; data += 64, size -= 64) {
+        transform(ctx->state, data);
+    }
+    memcpy(ctx->block, data, size);
+    ctx->used = size;
+}
+
+static void sha_final(ShaContext *ctx, u8 *out, u32 words, ShaTransform transform) {
+    u64 bits = ctx->length * 8;
+
+    ctx->block[ctx->used++] = 0x80;
+    if (ctx->used > 56) {
+        memset(ctx->block + ctx->used, 0, 64 - ctx->used);
+        transform(ctx->state, ctx->block);
+        ctx->used = 0;
+    }
+    memset(ctx->block + ctx->used, 0, 56 - ctx->used);
+    store_be32(ctx->block + 56, bits >> 32);
+    store_be32(ctx->block + 60, bits);
+    transform(ctx->state, ctx->block);
+
+    for (u32 i = 0; i < words; i++) {
+        store_be32(out + i * 4, ctx->state[i]);
+    }
+}
+
+static void crc32_init(u32 *table) {
+    for (u32 i = 0; i < 256; i++) {
+        u32 crc = i;
+        for (u32 bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+        table[i] = crc;
+    }
+}
+
+static u32 crc32_update(const u32 *table, u32 crc, const u8 *data, u32 size) {
+    while (size--) {
+        crc = table[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+static int hash_read_async(HashJob *job, u8 *buffer, u64 pos, u32 length, FSAAsyncRequest *request) {
+    if (job->params->flags & HASH_FLAG_RAW) {
+        return FSA_RawReadWriteAsync(job->fsaFd, buffer, HASH_SECTOR_SIZE, length / HASH_SECTOR_SIZE, pos / HASH_SECTOR_SIZE,
+                                     job->handle, true, job->queueId, request);
+    }
+    return FSA_ReadWriteFileWithPosAsync(job->fsaFd, buffer, 1, length, (u32) pos, job->handle, FSA_READ_FLAG_READ_WITH_POS, true, job->queueId, request);
+}
+
+// Reads [start, end) with the next block read in the background while the current one is hashed.
+static int hash_stream(HashJob *job, u64 start, u64 end, HashResult *out) {
+    const HashParams *p = job->params;
+    ShaContext sha1     = {{0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0}};
+    ShaContext sha256   = {{0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19}};
+    u32 crc             = 0xFFFFFFFF;
+    FSAAsyncRequest request;
+
+    u64 pos      = start;
+    u32 current  = 0;
+    u32 inflight = end - pos < HASH_BUFFER_SIZE ? end - pos : HASH_BUFFER_SIZE;
+    int res      = inflight ? hash_read_async(job, job->buffers[0], pos, inflight, &request) : 0;
+    int pending  = inflight && res >= 0;
+
+    while (pending) {
+        ipcmessage *reply;
+        svcReceiveMessage(job->queueId, &reply, 0);
+        int length = FSA_FinishAsync(&request);
+        pending    = 0;
+        if (length < 0) {
+            res = length;
+            break;
+        }
+        // raw reads return 0, file reads the number of bytes
+        u32 got = (p->flags & HASH_FLAG_RAW) ? inflight : (u32) length;
+        if (got == 0) {
+            break;
+        }
+
+        pos += got;
+        if (pos < end) {
+            inflight = end - pos < HASH_BUFFER_SIZE ? end - pos : HASH_BUFFER_SIZE;
+            res      = hash_read_async(job, job->buffers[current ^ 1], pos, inflight, &request);
+            pending  = res >= 0;
+        }
+
+        u8 *data = job->buffers[current];
+        if (p->types & HASH_TYPE_CRC32) crc = crc32_update(job->crcTable, crc, data, got);
+        if (p->types & HASH_TYPE_SHA1) sha_update(&sha1, data, got, sha1_transform);
+        if (p->types & HASH_TYPE_SHA256) sha_update(&sha256, data, got, sha256_transform);
+        out->bytes += got;
+        current ^= 1;
+
+        if (res < 0) {
+            break;
+        }
+    }
+
+    if (pending) {
+        ipcmessage *reply;
+        svcReceiveMessage(job->queueId, &reply, 0);
+        FSA_FinishAsync(&request);
+    }
+
+    if (p->types & HASH_TYPE_CRC32) out->crc32 = ~crc;
+    if (p->types & HASH_TYPE_SHA1) sha_final(&sha1, out->sha1, 5, sha1_transform);
+    if (p->types & HASH_TYPE_SHA256) sha_final(&sha256, out->sha256, 8, sha256_transform);
+    return res;
+}
+
+void hash_init(void) {
+    mutex_init(&hashMutex);
+}
+
+int hash_run(const HashParams *params, HashResult *out) {
+    HashParams p;
+    HashJob job;
+    u32 messageQueue[1];
+
+    memset(out, 0, sizeof(*out));
+    memset(&job, 0, sizeof(job));
+    memcpy(&p, params, sizeof(p));
+    p.path[sizeof(p.path) - 1] = '\0';
+
+    if (!(p.types & (HASH_TYPE_CRC32 | HASH_TYPE_SHA1 | HASH_TYPE_SHA256)) ||
+        ((p.flags & HASH_FLAG_RAW) && (p.length == 0 || (p.length % HASH_SECTOR_SIZE) || (p.offset > U64_MAX / HASH_SECTOR_SIZE)))) {
+        return out->result = IOS_ERROR_INVALID_ARG;
+    }
+
+    mutex_lock(&hashMutex);
+    job.params     = &p;
+    job.fsaFd      = -1;
+    job.handle     = -1;
+    job.queueId    = -1;
+    job.buffers[0] = (u8 *) heap_alloc_align(HASH_BUFFER_SIZE, 0x40);
+    job.buffers[1] = (u8 *) heap_alloc_align(HASH_BUFFER_SIZE, 0x40);
+    job.crcTable   = (u32 *) heap_alloc(256 * sizeof(u32));
+    int res        = (job.buffers[0] && job.buffers[1] && job.crcTable) ? 0 : IOS_ERROR_UNKNOWN;
+
+    if (res >= 0) {
+        crc32_init(job.crcTable);
+        job.fsaFd = svcOpen("/dev/fsa", 0);
+        res       = job.fsaFd;
+    }
+    if (res >= 0) {
+        job.queueId = svcCreateMessageQueue(messageQueue, 1);
+        res         = job.queueId;
+    }
+
+    u64 start = 0;
+    u64 end   = 0;
+    if (res >= 0 && (p.flags & HASH_FLAG_RAW)) {
+        res   = FSA_RawOpen(job.fsaFd, p.path, &job.handle);
+        start = p.offset * HASH_SECTOR_SIZE;
+        end   = start + p.length;
+    } else if (res >= 0) {
+        FSStat stat;
+        res = FSA_OpenFile(job.fsaFd, p.path, "r", &job.handle);
+        if (res >= 0) {
+            res = FSA_GetStatFile(job.fsaFd, job.handle, &stat);
+            if (res < 0) {
+                FSA_CloseFile(job.fsaFd, job.handle);
+            }
+        }
+        if (res >= 0) {
+            start = p.offset < stat.size ? p.offset : stat.size;
+            end   = (p.length == 0 || p.length > stat.size - start) ? stat.size : start + p.length;
+        }
+    }
+    if (res < 0) {
+        job.handle = -1;
+    }
+
+    u32 startTicks = timer_ticks();
+    if (res >= 0) {
+        res = hash_stream(&job, start, end, out);
+    }
+    out->elapsed_us = ticks_to_us(timer_ticks() - startTicks);
+
+    if (job.handle >= 0) {
+        if (p.flags & HASH_FLAG_RAW) {
+            FSA_RawClose(job.fsaFd, job.handle);
+        } else {
+            FSA_CloseFile(job.fsaFd, job.handle);
+        }
+    }
+    if (job.queueId >= 0) {
+        svcDestroyMessageQueue(job.queueId);
+    }
+    if (job.fsaFd >= 0) {
+        svcClose(job.fsaFd);
+    }
+    if (job.buffers[0]) heap_free(job.buffers[0]);
+    if (job.buffers[1]) heap_free(job.buffers[1]);
+    if (job.crcTable) heap_free(job.crcTable);
+    mutex_unlock(&hashMutex);
+
+    out->result = res < 0 ? res : 0;
+    return out->result;
+}
@@ -0,0 +1,46 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include "types.h"
+
+#define HASH_TYPE_CRC32    0x01
+#define HASH_TYPE_SHA1     0x02
+#define HASH_TYPE_SHA256   0x04
+
+#define HASH_FLAG_RAW      0x01 // FSA_RawRead on a device instead of a file
+
+#define HASH_SECTOR_SIZE   0x200
+#ifndef HASH_BUFFER_SIZE
+#define HASH_BUFFER_SIZE   0x20000 // two of them, one is read while the other one is hashed
+#endif
+
+#ifdef MOCHA_FSA_TOOLS
+// the buffers of the running hash
+#define HASH_HEAP_SIZE (2 * HEAP_BLOCK_SIZE(HASH_BUFFER_SIZE, 0x40) + HEAP_BLOCK_SIZE(256 * sizeof(u32), 0x10))
+#else
+#define HASH_HEAP_SIZE 0
+#endif
+
+typedef struct HashParams {
+    u32 types;   // HASH_TYPE_*, all of them are computed in the same pass
+    u32 flags;
+    u64 offset;  // file: byte offset, raw: first sector
+    u64 length;  // bytes, 0 = up to the end of the file. Raw mode: multiple of HASH_SECTOR_SIZE, not 0
+    char path[0x100]; // file path, or device path like "/dev/sdcard01" in raw mode
+} HashParams;
+
+typedef struct HashResult {
+    s32 result; // 0 or the first failing FSA result
+    u32 elapsed_us;
+    u64 bytes;
+    u32 crc32;
+    u8 sha1[20];
+    u8 sha256[32];
+} HashResult;
+
+void hash_init(void);
+
+// Hashes a file or a raw device range, waits while another hash runs.
+int hash_run(const HashParams *params, HashResult *out);
+
+#endif
@@ -0,0 +1,137 @@
+#include "heap.h"
+#include "filecache.h"
+#include "fsa_tree.h"
+#include "hash.h"
+#include "ipc.h"
+#include "ring.h"
+#include "session.h"
+#include "slab.h"
+#include "statcache.h"
+#include "svc.h"
+#include "utils.h"
+#include "watch.h"
+#include <string.h>
+
+#define HEAP_MIN_ALIGN      0x10
+#define HEAP_TRANSIENT_SIZE 0x10000 // short-lived allocations, e.g. batch input copies and paths
+
+#ifndef MOCHA_JOB_HEAP_SIZE
+// jobs whose size the client chooses: benchmarks, memory snapshots, scripts and wupserver allocations
+#define MOCHA_JOB_HEAP_SIZE 0x40000
+#endif
+
+#ifndef MOCHA_HEAP_SIZE
+// The pools of the enabled features, the buffers of a tree copy and a hash, and room for the jobs and
+// short-lived allocations. Anything beyond that fails and is counted in the failures of heap_get_stats.
+#define MOCHA_HEAP_SIZE                                                                                                                  \
+    ((SLAB_HEAP_SIZE + SESSION_HEAP_SIZE + STATCACHE_HEAP_SIZE + FILECACHE_HEAP_SIZE + IPC_HEAP_SIZE + RING_HEAP_SIZE + WATCH_HEAP_SIZE + \
+      FSA_TREE_HEAP_SIZE + HASH_HEAP_SIZE + MOCHA_JOB_HEAP_SIZE + HEAP_TRANSIENT_SIZE + 0xFFF) &                                        \
+     ~0xFFF)
+#endif
+
+// stored right in front of every block, so it can be freed from the heap it came from
+typedef struct {
+    u32 heapId;
+    u32 offset; // from the start of the allocation to the block
+    u32 size;   // of the whole allocation
+} HeapHeader;
+
+static int heapId; // -1 without a private heap, set by heap_init as .data is not loaded
+static u8 *heapStart;
+static u8 *heapEnd;
+static HeapStats stats;
+static mutex_t heapMutex;
+
+void heap_init(void) {
+    mutex_init(&heapMutex);
+    heapId        = -1;
+    stats.heap_id = -1;
+
+    u8 *memory = (u8 *) svcAllocAlign(HEAP_SHARED_ID, MOCHA_HEAP_SIZE, 0x40);
+    if (!memory) {
+        return;
+    }
+    heapId = svcCreateHeap(memory, MOCHA_HEAP_SIZE);
+    if (heapId < 0) {
+        svcFree(HEAP_SHARED_ID, memory);
+        return;
+    }
+    heapStart     = memory;
+    heapEnd       = memory + MOCHA_HEAP_SIZE;
+    stats.heap_id = heapId;
+    stats.size    = MOCHA_HEAP_SIZE;
+}
+
+int heap_contains(void *ptr) {
+    u8 *block = (u8 *) ptr;
+    if (heapId < 0 || block < heapStart + sizeof(HeapHeader) || block >= heapEnd || ((u32) block & (HEAP_MIN_ALIGN - 1))) {
+        return 0;
+    }
+    // a pointer into the middle of a block has no valid header in front of it
+    HeapHeader *header = (HeapHeader *) block - 1;
+    return header->heapId == (u32) heapId && header->offset >= HEAP_MIN_ALIGN && header->offset <= (u32) (block - heapStart) &&
+           header->size <= (u32) (heapEnd - block) + header->offset;
+}
+
+void *heap_alloc_align(u32 size, u32 align) {
+    if (align < HEAP_MIN_ALIGN) {
+        align = HEAP_MIN_ALIGN;
+    }
+    u32 total = size + align;
+
+    // the shared heap only stands in when heap_init could not create the private one
+    int id    = (heapId >= 0) ? heapId : HEAP_SHARED_ID;
+    u8 *block = (u8 *) svcAllocAlign(id, total, align);
+
+    mutex_lock(&heapMutex);
+    if (!block) {
+        stats.failures++;
+    } else if (id == HEAP_SHARED_ID) {
+        stats.shared_allocs++;
+    } else {
+        stats.allocs++;
+        stats.used += total;
+        if (stats.used > stats.peak_used) {
+            stats.peak_used = stats.used;
+        }
+    }
+    mutex_unlock(&heapMutex);
+
+    if (!block) {
+        return NULL;
+    }
+    HeapHeader *header = (HeapHeader *) (block + align) - 1;
+    header->heapId     = id;
+    header->offset     = align;
+    header->size       = total;
+    return block + align;
+}
+
+void *heap_alloc(u32 size) {
+    return heap_alloc_align(size, HEAP_MIN_ALIGN);
+}
+
+void heap_free(void *ptr) {
+    if (!ptr) {
+        return;
+    }
+    HeapHeader *header = (HeapHeader *) ptr - 1;
+    u32 id             = header->heapId;
+    u32 size           = header->size;
+    svcFree(id, (u8 *) ptr - header->offset);
+
+    mutex_lock(&heapMutex);
+    if (id == HEAP_SHARED_ID) {
+        stats.shared_allocs--;
+    } else {
+        stats.allocs--;
+        stats.used -= size;
+    }
+    mutex_unlock(&heapMutex);
+}
+
+void heap_get_stats(HeapStats *out) {
+    mutex_lock(&heapMutex);
+    memcpy(out, &stats, sizeof(HeapStats));
+    mutex_unlock(&heapMutex);
+}
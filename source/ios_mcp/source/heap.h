@@ -0,0 +1,67 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "svc.h"
+#include "types.h"
+
+#define HEAP_SHARED_ID 0xCAFF // the heap of the system, used when the private one could not be created
+
+// Space a block of size bytes takes from the private heap. heap_alloc_align puts its header into
+// the alignment in front of the block, the IOS heap adds a header and alignment padding of its own.
+#define HEAP_BLOCK_SIZE(size, align) ((size) + 2 * (align) + 0x10)
+
+typedef struct HeapStats {
+    s32 heap_id; // private heap, negative when it could not be created
+    u32 size;
+    u32 used;      // bytes allocated from the private heap, including headers
+    u32 peak_used;
+    u32 allocs;    // blocks allocated right now
+    u32 shared_allocs; // blocks that came from the shared heap because there is no private one
+    u32 failures;      // allocations that did not fit, a full private heap does not fall back to the shared one
+} HeapStats;
+
+#ifdef MOCHA_HEAP
+
+// Creates the private heap out of one block of the shared heap, has to run before anything is allocated.
+// The memory stays in the shared region, so buffers can still be passed to other resource managers.
+void heap_init(void);
+
+// Whether ptr is a block heap_alloc or heap_alloc_align returned from the private heap.
+int heap_contains(void *ptr);
+
+void *heap_alloc(u32 size);
+
+void *heap_alloc_align(u32 size, u32 align);
+
+// Frees a block from heap_alloc or heap_alloc_align, NULL is ignored.
+void heap_free(void *ptr);
+
+void heap_get_stats(HeapStats *stats);
+
+#else
+
+// without the private heap everything comes from the shared one
+static inline void heap_init(void) {
+}
+
+static inline void *heap_alloc(u32 size) {
+    return svcAlloc(HEAP_SHARED_ID, size);
+}
+
+static inline void *heap_alloc_align(u32 size, u32 align) {
+    return svcAllocAlign(HEAP_SHARED_ID, size, align);
+}
+
+static inline void heap_free(void *ptr) {
+    if (ptr) {
+        svcFree(HEAP_SHARED_ID, ptr);
+    }
+}
+
+static inline int heap_contains(void *ptr) {
+    return 0;
+}
+
+#endif
+
+#endif
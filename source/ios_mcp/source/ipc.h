@@ -1,6 +1,157 @@
 #ifndef _IPC_H_
 #define _IPC_H_
 
+#include "fsa.h"
+
+#define IOCTL_MEM_WRITE              0x00
+#define IOCTL_MEM_READ               0x01
+#define IOCTL_SVC                    0x02
+#define IOCTL_KILL_SERVER            0x03
+#define IOCTL_MEMCPY                 0x04
+#define IOCTL_REPEATED_WRITE         0x05
+#define IOCTL_KERN_READ32            0x06
+#define IOCTL_KERN_WRITE32           0x07
+#define IOCTL_READ_OTP               0x08
+#define IOCTL_MEM_SNAPSHOT           0x09
+#define IOCTL_MEM_DIFF               0x0A
+#define IOCTL_MEM_SEARCH             0x0B
+#define IOCTL_WATCH_ADD              0x0C
+#define IOCTL_WATCH_REMOVE           0x0D
+#define IOCTL_WATCH_POLL             0x0E
+#define IOCTL_WATCH_INTERVAL         0x0F
+#define IOCTL_KERN_VECTOR            0x10
+#define IOCTL_KERN_READ              0x11
+#define IOCTL_KERN_WRITE             0x12
+#define IOCTL_RING_SETUP             0x13
+#define IOCTL_RING_DOORBELL          0x14
+#define IOCTL_MEM_READV              0x15
+#define IOCTL_MEM_WRITEV             0x16
+#define IOCTL_HEAP_STATS             0x17
+
+#define IOCTL_FSA_OPEN               0x40
+#define IOCTL_FSA_CLOSE              0x41
+#define IOCTL_FSA_MOUNT              0x42
+#define IOCTL_FSA_UNMOUNT            0x43
+#define IOCTL_FSA_GETINFO            0x44
+#define IOCTL_FSA_OPENDIR            0x45
+#define IOCTL_FSA_READDIR            0x46
+#define IOCTL_FSA_CLOSEDIR           0x47
+#define IOCTL_FSA_MAKEDIR            0x48
+#define IOCTL_FSA_OPENFILE           0x49
+#define IOCTL_FSA_READFILE           0x4A
+#define IOCTL_FSA_WRITEFILE          0x4B
+#define IOCTL_FSA_GETSTATFILE        0x4C
+#define IOCTL_FSA_CLOSEFILE          0x4D
+#define IOCTL_FSA_SETPOSFILE         0x4E
+#define IOCTL_FSA_GETSTAT            0x4F
+#define IOCTL_FSA_REMOVE             0x50
+#define IOCTL_FSA_REWINDDIR          0x51
+#define IOCTL_FSA_CHDIR              0x52
+#define IOCTL_FSA_RENAME             0x53
+#define IOCTL_FSA_RAW_OPEN           0x54
+#define IOCTL_FSA_RAW_READ           0x55
+#define IOCTL_FSA_RAW_WRITE          0x56
+#define IOCTL_FSA_RAW_CLOSE          0x57
+#define IOCTL_FSA_CHANGEMODE         0x58
+#define IOCTL_FSA_FLUSHVOLUME        0x59
+#define IOCTL_CHECK_IF_IOSUHAX       0x5B
+
+// Extended mode
+#define IOCTL_FSA_CHANGEOWNER        0x5C
+#define IOCTL_FSA_OPENFILEEX         0x5D
+#define IOCTL_FSA_READFILEWITHPOS    0x5E
+#define IOCTL_FSA_WRITEFILEWITHPOS   0x5F
+#define IOCTL_FSA_APPENDFILE         0x60
+#define IOCTL_FSA_APPENDFILEEX       0x61
+#define IOCTL_FSA_FLUSHFILE          0x62
+#define IOCTL_FSA_TRUNCATEFILE       0x63
+#define IOCTL_FSA_GETPOSFILE         0x64
+#define IOCTL_FSA_ISEOF              0x65
+#define IOCTL_FSA_ROLLBACKVOLUME     0x66
+#define IOCTL_FSA_GETCWD             0x67
+#define IOCTL_FSA_MAKEQUOTA          0x68
+#define IOCTL_FSA_FLUSHQUOTA         0x69
+#define IOCTL_FSA_ROLLBACKQUOTA      0x6A
+#define IOCTL_FSA_ROLLBACKQUOTAFORCE 0x6B
+#define IOCTL_FSA_CHANGEMODEEX       0x6C
+#define IOCTL_FSA_REGISTERFLUSHQUOTA 0x6D
+#define IOCTL_FSA_FLUSHMULTIQUOTA    0x6E
+#define IOCTL_FSA_BENCHMARK          0x6F
+#define IOCTL_FSA_BATCH              0x70
+#define IOCTL_FSA_CACHE_CONFIG       0x71
+#define IOCTL_FSA_CACHE_STATS        0x72
+#define IOCTL_FSA_WRITE_BUFFER       0x73
+#define IOCTL_FSA_STATCACHE          0x74
+#define IOCTL_FSA_READDIR_MULTI      0x75
+#define IOCTL_FSA_COPY               0x76
+#define IOCTL_FSA_COPY_STATUS        0x77
+#define IOCTL_FSA_HASH               0x78
+#define IOCTL_FSA_REMOVE_RECURSIVE   0x79
+#define IOCTL_FSA_MAKEDIR_RECURSIVE  0x7A
+
+// Old bindings that are now renamed
+#define IOCTL_FSA_GETDEVICEINFO      IOCTL_FSA_GETINFO
+#define IOCTL_FSA_SETFILEPOS         IOCTL_FSA_SETPOSFILE
+
+#define IPC_QUEUE_SIZE 0x40
+
+// handler threads of the slow lane, the fast lane has one
+#ifndef IPC_SLOW_WORKERS
+#define IPC_SLOW_WORKERS 3
+#endif
+#define IPC_FAST_WORKERS      1
+#define IPC_WORKER_STACK_SIZE 0x1000
+#define IPC_MAX_DEFERRED      0x20
+
+// the worker stacks, the ioctlv requests and the completion thread
+#ifdef MOCHA_IPC_LANES
+#define IPC_LANES_HEAP_SIZE ((IPC_SLOW_WORKERS + IPC_FAST_WORKERS) * HEAP_BLOCK_SIZE(IPC_WORKER_STACK_SIZE, 0x20))
+#else
+#define IPC_LANES_HEAP_SIZE 0
+#endif
+#ifdef MOCHA_FSA_IOCTLV
+#define IPC_IOCTLV_HEAP_SIZE (HEAP_BLOCK_SIZE(sizeof(FSAAsyncRequest) * IPC_MAX_DEFERRED, 0x10) + HEAP_BLOCK_SIZE(IPC_WORKER_STACK_SIZE, 0x20))
+#else
+#define IPC_IOCTLV_HEAP_SIZE 0
+#endif
+#define IPC_HEAP_SIZE (IPC_LANES_HEAP_SIZE + IPC_IOCTLV_HEAP_SIZE)
+
+// Handles an ioctl of /dev/iosuhax and returns the reply value.
+int ipc_ioctl(ipcmessage *message);
+
+// Handles a request and replies to it, unless its reply is sent once a deferred transfer is done.
+void ipc_handle(ipcmessage *message);
+
+// Handles the FSA commands, passes any other command on to ipc_ext_ioctl.
+int ipc_fsa_ioctl(ipcmessage *message);
+
+#ifdef MOCHA_EXT
+// ipc_ext.c serves the optional features from the extension region, see link.ld.
+
+// Starts the caches, threads and queues of the enabled features.
+void ipc_ext_init(void);
+
+// Handles the ioctls of the enabled features, IOS_ERROR_INVALID_ARG for any other command.
+int ipc_ext_ioctl(ipcmessage *message);
+#else
+static inline void ipc_ext_init(void) {
+}
+
+static inline int ipc_ext_ioctl(ipcmessage *message) {
+    return IOS_ERROR_INVALID_ARG;
+}
+#endif
+
+#ifdef MOCHA_FSA_IOCTLV
+// Returns the reply value, *deferred is set if ipc_completion_thread replies instead.
+int ipc_ioctlv(ipcmessage *message, int *deferred);
+#endif
+
+#ifdef MOCHA_IPC_LANES
+// Hands an ioctl or ioctlv to the worker of its lane, 0 if the caller has to handle it.
+int ipc_lanes_queue(ipcmessage *message);
+#endif
+
 void ipc_init();
 
 void ipc_deinit();
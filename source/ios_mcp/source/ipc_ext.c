@@ -0,0 +1,877 @@
+#include "../../common/kernel_commands.h"
+#include "benchmark.h"
+#include "filecache.h"
+#include "fsa.h"
+#include "fsa_tree.h"
+#include "hash.h"
+#include "heap.h"
+#include "imports.h"
+#include "ipc.h"
+#include "logger.h"
+#include "memsearch.h"
+#include "memsnap.h"
+#include "memvec.h"
+#include "ring.h"
+#include "session.h"
+#include "statcache.h"
+#include "svc.h"
+#include "watch.h"
+#include <string.h>
+
+#ifdef MOCHA_FSA_BATCH
+#define FSA_BATCH_MAX_OPS            32
+#define FSA_BATCH_FLAG_STOP_ON_ERROR 0x01
+
+#define FSA_READDIR_FLAG_NAMES_ONLY  0x01 // only the flags word of the FSStat is returned with each name
+#define FSA_READDIR_STATE_MORE       0
+#define FSA_READDIR_STATE_END        1
+
+// sub-operation of IOCTL_FSA_BATCH, followed by length_in bytes of input for the command
+typedef struct {
+    u32 command;   // IOCTL_FSA_OPEN - IOCTL_FSA_FLUSHMULTIQUOTA
+    u32 length_in; // multiple of 4
+    u32 length_io;
+    u32 link;      // 0 or (source op + 1) << 16 | source word << 8 | input word, replaces the input word
+                   // with a word of an earlier op's output, e.g. the handle from IOCTL_FSA_OPENFILE
+} FSABatchOp;
+#endif
+
+#define IPC_NOBLOCK 1
+
+#ifdef MOCHA_IPC_LANES
+static u32 fastQueue[IPC_QUEUE_SIZE];
+static u32 slowQueue[IPC_QUEUE_SIZE];
+static int fastQueueId;
+static int slowQueueId;
+#endif
+
+#ifdef MOCHA_FSA_IOCTLV
+// ioctlv transfers in flight, their FSAAsyncRequests are handed out through deferredFreeQueue
+static u32 completionQueue[IPC_MAX_DEFERRED];
+static u32 deferredFreeQueue[IPC_MAX_DEFERRED];
+// set to -1 by ipc_start_completion, initialised statics end up in .data which link.ld discards
+static int completionQueueId;
+static int deferredFreeQueueId;
+#endif
+
+#ifdef MOCHA_FSA_BATCH
+// Bytes an FSA command writes to buffer_io, the length_io of a batch op has to cover them.
+static u32 ipc_fsa_output_size(u32 command, u32 *in, u32 length_in) {
+    switch (command) {
+        case IOCTL_FSA_OPENDIR:
+        case IOCTL_FSA_OPENFILE:
+        case IOCTL_FSA_OPENFILEEX:
+        case IOCTL_FSA_RAW_OPEN:
+        case IOCTL_FSA_GETPOSFILE:
+            return 8;
+        case IOCTL_FSA_GETINFO: // FSStat is the largest info
+        case IOCTL_FSA_GETSTAT:
+        case IOCTL_FSA_GETSTATFILE:
+            return 4 + sizeof(FSStat);
+        case IOCTL_FSA_READDIR:
+            return 4 + sizeof(FSDirectory);
+        case IOCTL_FSA_GETCWD:
+            return (length_in < 8 || in[1] > 0x27F) ? 0xFFFFFFFF : 4 + in[1];
+        case IOCTL_FSA_READFILE:
+        case IOCTL_FSA_READFILEWITHPOS:
+        case IOCTL_FSA_RAW_READ: {
+            if (length_in < 12) {
+                return 0xFFFFFFFF;
+            }
+            u64 size = 0x40 + (u64) in[1] * in[2];
+            return (size > 0xFFFFFFFF) ? 0xFFFFFFFF : (u32) size;
+        }
+        default:
+            return 4;
+    }
+}
+
+// Checks that the input of a batched op holds every argument word its command reads, that
+// path offsets point at a string inside the input and that write data fits behind 0x40.
+static int ipc_fsa_input_valid(u32 command, u32 *in, u32 length_in) {
+    u32 words = 2;
+    u32 paths = 0; // mask of the words that hold a string offset
+    int write = 0;
+    switch (command) {
+        case IOCTL_FSA_OPEN:
+        case IOCTL_CHECK_IF_IOSUHAX:
+            words = 0;
+            break;
+        case IOCTL_FSA_CLOSE:
+            words = 1;
+            break;
+        case IOCTL_FSA_MOUNT:
+            words = 6;
+            paths = (1 << 1) | (1 << 2);
+            break;
+        case IOCTL_FSA_UNMOUNT:
+        case IOCTL_FSA_GETINFO:
+        case IOCTL_FSA_MAKEDIR:
+        case IOCTL_FSA_CHANGEMODE:
+            words = 3;
+            paths = 1 << 1;
+            break;
+        case IOCTL_FSA_OPENDIR:
+        case IOCTL_FSA_GETSTAT:
+        case IOCTL_FSA_REMOVE:
+        case IOCTL_FSA_CHDIR:
+        case IOCTL_FSA_RAW_OPEN:
+        case IOCTL_FSA_FLUSHVOLUME:
+        case IOCTL_FSA_ROLLBACKVOLUME:
+        case IOCTL_FSA_FLUSHQUOTA:
+        case IOCTL_FSA_ROLLBACKQUOTA:
+        case IOCTL_FSA_ROLLBACKQUOTAFORCE:
+        case IOCTL_FSA_REGISTERFLUSHQUOTA:
+        case IOCTL_FSA_FLUSHMULTIQUOTA:
+            paths = 1 << 1;
+            break;
+        case IOCTL_FSA_OPENFILE:
+        case IOCTL_FSA_RENAME:
+            words = 3;
+            paths = (1 << 1) | (1 << 2);
+            break;
+        case IOCTL_FSA_OPENFILEEX:
+            words = 6;
+            paths = (1 << 1) | (1 << 2);
+            break;
+        case IOCTL_FSA_CHANGEOWNER:
+        case IOCTL_FSA_CHANGEMODEEX:
+            words = 4;
+            paths = 1 << 1;
+            break;
+        case IOCTL_FSA_MAKEQUOTA:
+            words = 5;
+            paths = 1 << 1;
+            break;
+        case IOCTL_FSA_SETPOSFILE:
+            words = 3;
+            break;
+        case IOCTL_FSA_APPENDFILE:
+            words = 4;
+            break;
+        case IOCTL_FSA_READFILE:
+        case IOCTL_FSA_APPENDFILEEX:
+            words = 5;
+            break;
+        case IOCTL_FSA_READFILEWITHPOS:
+        case IOCTL_FSA_RAW_READ:
+            words = 6;
+            break;
+        case IOCTL_FSA_WRITEFILE:
+            words = 5;
+            write = 1;
+            break;
+        case IOCTL_FSA_WRITEFILEWITHPOS:
+        case IOCTL_FSA_RAW_WRITE:
+            words = 6;
+            write = 1;
+            break;
+        default:
+            break;
+    }
+    if (length_in < words * 4) {
+        return 0;
+    }
+    if (command == IOCTL_FSA_MOUNT && in[4] > 0) {
+        paths |= 1 << 4; // the argument string is optional
+    }
+    for (u32 i = 1; i < words; i++) {
+        if (!(paths & (1 << i))) {
+            continue;
+        }
+        if (in[i] >= length_in) {
+            return 0;
+        }
+        const char *str = (const char *) in + in[i];
+        const char *end = (const char *) in + length_in;
+        while (str < end && *str) {
+            str++;
+        }
+        if (str == end) {
+            return 0;
+        }
+    }
+    // the data of a write starts at 0x40
+    return !write || 0x40 + (u64) in[1] * in[2] <= length_in;
+}
+
+// in: [count][flags][FSABatchOp][input]...
+// io: [number of ops run][result of each op][output of each op, every one 0x40 aligned]
+// An op that links to a failed op is not run and gets the same result.
+// An op whose input is too short for its command, or whose length_io is too small for the output
+// of its command, fails with IOS_ERROR_INVALID_SIZE.
+static int ipc_fsa_batch(u32 session, u32 *buffer_in, u32 length_in, u32 *buffer_io, u32 length_io) {
+    u32 *outputs[FSA_BATCH_MAX_OPS];
+    u32 outputLengths[FSA_BATCH_MAX_OPS];
+
+    if (length_in < 8 || buffer_in[0] == 0 || buffer_in[0] > FSA_BATCH_MAX_OPS || length_io < 4 + buffer_in[0] * 4) {
+        return IOS_ERROR_INVALID_SIZE;
+    }
+
+    u32 count    = buffer_in[0];
+    u32 flags    = buffer_in[1];
+    u32 *results = buffer_io + 1;
+    u8 *in       = (u8 *) (buffer_in + 2);
+    u8 *inEnd    = (u8 *) buffer_in + length_in;
+    u32 ioOffset = (4 + count * 4 + 0x3F) & ~0x3F;
+    buffer_io[0] = 0;
+
+    for (u32 i = 0; i < count; i++) {
+        FSABatchOp *op = (FSABatchOp *) in;
+        if (in + sizeof(FSABatchOp) > inEnd || op->length_in > (u32) (inEnd - in) - sizeof(FSABatchOp) || (op->length_in & 3) ||
+            ioOffset > length_io || op->length_io > length_io - ioOffset) {
+            return IOS_ERROR_INVALID_SIZE;
+        }
+
+        u32 *opIn        = (u32 *) (op + 1);
+        u32 *opIo        = (u32 *) ((u8 *) buffer_io + ioOffset);
+        u32 *copy        = 0;
+        int res          = 0;
+        outputs[i]       = opIo;
+        outputLengths[i] = op->length_io;
+
+        if (op->command < IOCTL_FSA_OPEN || op->command > IOCTL_FSA_FLUSHMULTIQUOTA) {
+            res = IOS_ERROR_INVALID_ARG;
+        } else if (op->link) {
+            u32 source     = (op->link >> 16) - 1;
+            u32 sourceWord = (op->link >> 8) & 0xFF;
+            u32 inputWord  = op->link & 0xFF;
+            if (source >= i || sourceWord * 4 >= outputLengths[source] || inputWord * 4 >= op->length_in) {
+                res = IOS_ERROR_INVALID_ARG;
+            } else if ((int) results[source] < 0) {
+                res = results[source];
+            } else {
+                // the input buffer is the client's, patch a copy
+                copy = (u32 *) heap_alloc(op->length_in);
+                if (!copy) {
+                    res = IOS_ERROR_UNKNOWN;
+                } else {
+                    memcpy(copy, opIn, op->length_in);
+                    copy[inputWord] = outputs[source][sourceWord];
+                    opIn            = copy;
+                }
+            }
+        }
+
+        // checked after linking, a linked word can be the size of a read
+        if (res == 0 && (!ipc_fsa_input_valid(op->command, opIn, op->length_in) || op->length_io < ipc_fsa_output_size(op->command, opIn, op->length_in))) {
+            res = IOS_ERROR_INVALID_SIZE;
+        }
+        if (res == 0) {
+            ipcmessage sub;
+            sub.fd              = session;
+            sub.ioctl.command   = op->command;
+            sub.ioctl.buffer_in = opIn;
+            sub.ioctl.length_in = op->length_in;
+            sub.ioctl.buffer_io = opIo;
+            sub.ioctl.length_io = op->length_io;
+
+            res = ipc_ioctl(&sub);
+            // the FSA commands return their result in the first output word
+            if (res == 0) {
+                res = opIo[0];
+            }
+        }
+        if (copy) {
+            heap_free(copy);
+        }
+
+        results[i]   = res;
+        buffer_io[0] = i + 1;
+        in += sizeof(FSABatchOp) + op->length_in;
+        ioOffset += (op->length_io + 0x3F) & ~0x3F;
+
+        if (res < 0 && (flags & FSA_BATCH_FLAG_STOP_ON_ERROR)) {
+            break;
+        }
+    }
+    return 0;
+}
+
+// in: [fd][handle][max entries, 0 = as many as fit][flags]
+// io: [result][entry count][state][entries]...
+// Every entry is the FSStat of the file (or just its flags word with FSA_READDIR_FLAG_NAMES_ONLY),
+// the length of the name and the name with its terminator, padded to 4 bytes. Entries are only
+// read while one of the maximum size still fits, none get lost between calls. The state is
+// FSA_READDIR_STATE_END once the end of the directory was reached.
+static int ipc_fsa_readdir_multi(u32 *buffer_in, u32 length_in, u32 *buffer_io, u32 length_io) {
+    if (length_in < 16 || length_io < 12) {
+        return IOS_ERROR_INVALID_SIZE;
+    }
+
+    int fd         = buffer_in[0];
+    int handle     = buffer_in[1];
+    u32 maxEntries = buffer_in[2];
+    u32 flags      = buffer_in[3];
+    u32 statSize   = (flags & FSA_READDIR_FLAG_NAMES_ONLY) ? 4 : sizeof(FSStat);
+    u32 maxSize    = statSize + 4 + sizeof(((FSDirectory *) 0)->name);
+    u8 *out        = (u8 *) (buffer_io + 3);
+    u8 *outEnd     = (u8 *) buffer_io + length_io;
+    FSDirectory dir;
+
+    buffer_io[0] = 0;
+    buffer_io[1] = 0;
+    buffer_io[2] = FSA_READDIR_STATE_MORE;
+
+    while ((maxEntries == 0 || buffer_io[1] < maxEntries) && (u32) (outEnd - out) >= maxSize) {
+        int res = FSA_ReadDir(fd, handle, &dir);
+        if (res == FSA_STATUS_END_OF_DIRECTORY) {
+            buffer_io[2] = FSA_READDIR_STATE_END;
+            break;
+        }
+        if (res < 0) {
+            buffer_io[0] = res;
+            break;
+        }
+
+        dir.name[sizeof(dir.name) - 1] = '\0';
+        u32 nameLength                 = strlen(dir.name);
+        memcpy(out, &dir.info, statSize);
+        memcpy(out + statSize, &nameLength, 4);
+        memcpy(out + statSize + 4, dir.name, nameLength + 1);
+        out += (statSize + 4 + nameLength + 1 + 3) & ~3;
+        buffer_io[1]++;
+    }
+    return 0;
+}
+#endif
+
+// Ioctls of the optional features, ipc_ioctl hands them over for every command it does not know.
+int ipc_ext_ioctl(ipcmessage *message) {
+    int res = 0;
+
+    switch (message->ioctl.command) {
+#ifdef MOCHA_MEMTOOLS
+        case IOCTL_KERN_READ: {
+            if ((message->ioctl.length_in < 4) || (message->ioctl.length_io == 0)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                svcCustomKernelCommand(KERNEL_MEMCPY, message->ioctl.buffer_io, message->ioctl.buffer_in[0], message->ioctl.length_io);
+            }
+            break;
+        }
+        case IOCTL_KERN_WRITE: {
+            // [0] = destination, data from [1]
+            if (message->ioctl.length_in <= 4) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                svcCustomKernelCommand(KERNEL_MEMCPY, message->ioctl.buffer_in[0], message->ioctl.buffer_in + 1, message->ioctl.length_in - 4);
+            }
+            break;
+        }
+        case IOCTL_KERN_VECTOR: {
+            u32 count = message->ioctl.length_in / sizeof(kernel_vector_op_t);
+            if ((count == 0) || (message->ioctl.length_io < 4 + count * 4)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                // [0] = number of ops executed, one result word per op from [1]
+                message->ioctl.buffer_io[0] = svcCustomKernelCommand(KERNEL_VECTOR, message->ioctl.buffer_in, count, message->ioctl.buffer_io + 1);
+            }
+            break;
+        }
+        case IOCTL_MEM_READV: {
+            // in: [MemVecEntry]..., io: the data of all entries
+            res = memvec_read((MemVecEntry *) message->ioctl.buffer_in, message->ioctl.length_in / sizeof(MemVecEntry), message->ioctl.buffer_io, message->ioctl.length_io);
+            if (res > 0) {
+                res = 0;
+            }
+            break;
+        }
+        case IOCTL_MEM_WRITEV: {
+            // in: [count][MemVecEntry x count][data of all entries]
+            if (message->ioctl.length_in < 4 || message->ioctl.buffer_in[0] > (message->ioctl.length_in - 4) / sizeof(MemVecEntry)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                u32 count = message->ioctl.buffer_in[0];
+                u32 used  = 4 + count * sizeof(MemVecEntry);
+
+                res = memvec_write((MemVecEntry *) (message->ioctl.buffer_in + 1), count, ((u8 *) message->ioctl.buffer_in) + used, message->ioctl.length_in - used);
+                if (res > 0) {
+                    res = 0;
+                }
+            }
+            break;
+        }
+#endif
+#ifdef MOCHA_HEAP
+        case IOCTL_HEAP_STATS: {
+            if (message->ioctl.length_io < sizeof(HeapStats)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                heap_get_stats((HeapStats *) message->ioctl.buffer_io);
+            }
+            break;
+        }
+#endif
+#ifdef MOCHA_RING
+        case IOCTL_RING_SETUP: {
+            // [0] = physical address of the ring or 0 to stop it, [1] = entries, see ring.h
+            if (message->ioctl.length_in < 8) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                res = ring_setup(message->fd, (void *) message->ioctl.buffer_in[0], message->ioctl.buffer_in[1]);
+            }
+            break;
+        }
+        case IOCTL_RING_DOORBELL: {
+            ring_doorbell();
+            break;
+        }
+#endif
+#ifdef MOCHA_MEMTOOLS
+        case IOCTL_MEM_SNAPSHOT: {
+            if ((message->ioctl.length_in < 16) || (message->ioctl.length_io < 4)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                u32 slot    = message->ioctl.buffer_in[0];
+                u32 address = message->ioctl.buffer_in[1];
+                u32 size    = message->ioctl.buffer_in[2];
+                u32 flags   = message->ioctl.buffer_in[3];
+
+                message->ioctl.buffer_io[0] = memsnap_take(slot, address, size, flags);
+            }
+            break;
+        }
+        case IOCTL_MEM_DIFF: {
+            if ((message->ioctl.length_in < 16) || (message->ioctl.length_io < 8)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                u32 slot   = message->ioctl.buffer_in[0];
+                u32 filter = message->ioctl.buffer_in[1];
+                u32 flags  = message->ioctl.buffer_in[2];
+                u32 offset = message->ioctl.buffer_in[3];
+
+                // [0] = bytes of records or error, [1] = offset to continue at, records from [2]
+                message->ioctl.buffer_io[0] = memsnap_diff(slot, filter, flags, offset, message->ioctl.buffer_io + 2, message->ioctl.length_io - 8, &message->ioctl.buffer_io[1]);
+            }
+            break;
+        }
+        case IOCTL_MEM_SEARCH: {
+            MemSearchParams *params = (MemSearchParams *) message->ioctl.buffer_in;
+            if ((message->ioctl.length_in < sizeof(MemSearchParams)) || (message->ioctl.length_io < 12) ||
+                (message->ioctl.length_in < sizeof(MemSearchParams) + params->pattern_length * 2)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                // [0] = number of matches or error, [1] = address to continue at, addresses from [2]
+                message->ioctl.buffer_io[0] = memsearch_run(params, message->ioctl.buffer_io + 2, (message->ioctl.length_io - 8) / 4, &message->ioctl.buffer_io[1]);
+            }
+            break;
+        }
+#endif
+#ifdef MOCHA_WATCH
+        case IOCTL_WATCH_ADD: {
+            if ((message->ioctl.length_in < sizeof(WatchParams)) || (message->ioctl.length_io < 4)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                message->ioctl.buffer_io[0] = watch_add((WatchParams *) message->ioctl.buffer_in);
+            }
+            break;
+        }
+        case IOCTL_WATCH_REMOVE: {
+            if (message->ioctl.length_in < 4) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                res = watch_remove((int) message->ioctl.buffer_in[0]);
+            }
+            break;
+        }
+        case IOCTL_WATCH_POLL: {
+            if (message->ioctl.length_io < 4) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                // [0] = number of events, WatchEvents from [1]
+                message->ioctl.buffer_io[0] = watch_poll((WatchEvent *) (message->ioctl.buffer_io + 1), (message->ioctl.length_io - 4) / sizeof(WatchEvent));
+            }
+            break;
+        }
+        case IOCTL_WATCH_INTERVAL: {
+            if (message->ioctl.length_in < 4) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                res = watch_set_interval(message->ioctl.buffer_in[0]);
+            }
+            break;
+        }
+#endif
+#ifdef MOCHA_BENCHMARK
+        case IOCTL_FSA_BENCHMARK: {
+            if ((message->ioctl.length_in < sizeof(BenchParams)) || (message->ioctl.length_io < sizeof(BenchResult))) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                bench_run((BenchParams *) message->ioctl.buffer_in, (BenchResult *) message->ioctl.buffer_io);
+            }
+            break;
+        }
+#endif
+#ifdef MOCHA_FSA_BATCH
+        case IOCTL_FSA_BATCH: {
+            res = ipc_fsa_batch(message->fd, message->ioctl.buffer_in, message->ioctl.length_in, message->ioctl.buffer_io, message->ioctl.length_io);
+            break;
+        }
+        case IOCTL_FSA_READDIR_MULTI: {
+            res = ipc_fsa_readdir_multi(message->ioctl.buffer_in, message->ioctl.length_in, message->ioctl.buffer_io, message->ioctl.length_io);
+            break;
+        }
+#endif
+#ifdef MOCHA_FSA_CACHE
+        case IOCTL_FSA_CACHE_CONFIG: {
+            if (message->ioctl.length_in < 8 || message->ioctl.length_io < 4) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                u32 block_size = message->ioctl.buffer_in[0];
+                u32 entries    = message->ioctl.buffer_in[1];
+
+                message->ioctl.buffer_io[0] = filecache_configure(block_size, entries);
+            }
+            break;
+        }
+        case IOCTL_FSA_CACHE_STATS: {
+            if (message->ioctl.length_io < sizeof(FileCacheStats)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                filecache_get_stats((FileCacheStats *) message->ioctl.buffer_io);
+            }
+            break;
+        }
+        case IOCTL_FSA_WRITE_BUFFER: {
+            int fd         = message->ioctl.buffer_in[0];
+            int fileHandle = message->ioctl.buffer_in[1];
+            u32 size       = message->ioctl.buffer_in[2];
+
+            message->ioctl.buffer_io[0] = filecache_set_write_buffer(fd, fileHandle, size);
+            break;
+        }
+        case IOCTL_FSA_STATCACHE: {
+            // in: optional [ttl in ms, 0 disables the cache], io: StatCacheStats
+            if (message->ioctl.length_io < sizeof(StatCacheStats)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                if (message->ioctl.length_in >= 4) {
+                    statcache_set_ttl(message->ioctl.buffer_in[0]);
+                }
+                statcache_get_stats((StatCacheStats *) message->ioctl.buffer_io);
+            }
+            break;
+        }
+#endif
+#ifdef MOCHA_FSA_TOOLS
+        case IOCTL_FSA_HASH: {
+            if ((message->ioctl.length_in < sizeof(HashParams)) || (message->ioctl.length_io < sizeof(HashResult))) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                hash_run((HashParams *) message->ioctl.buffer_in, (HashResult *) message->ioctl.buffer_io);
+            }
+            break;
+        }
+        case IOCTL_FSA_COPY: {
+            // in: [flags][source path offset][destination path offset]
+            if (message->ioctl.length_in < 12 || message->ioctl.length_io < 4) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                u32 flags = message->ioctl.buffer_in[0];
+                char *src = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+                char *dst = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[2];
+
+                message->ioctl.buffer_io[0] = fsa_tree_copy_start(src, dst, flags);
+            }
+            break;
+        }
+        case IOCTL_FSA_COPY_STATUS: {
+            // in: optional [1 = cancel the running copy], io: FSACopyStatus
+            if (message->ioctl.length_io < sizeof(FSACopyStatus)) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                if (message->ioctl.length_in >= 4 && message->ioctl.buffer_in[0]) {
+                    fsa_tree_copy_cancel();
+                }
+                fsa_tree_copy_status((FSACopyStatus *) message->ioctl.buffer_io);
+            }
+            break;
+        }
+        case IOCTL_FSA_REMOVE_RECURSIVE: {
+            // in: [fd][path offset], io: [removed entries or result]
+            if (message->ioctl.length_in < 8 || message->ioctl.length_io < 4) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                int fd     = message->ioctl.buffer_in[0];
+                char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+                message->ioctl.buffer_io[0] = fsa_tree_remove(fd, path);
+            }
+            break;
+        }
+        case IOCTL_FSA_MAKEDIR_RECURSIVE: {
+            // in: [fd][path offset][mode], io: [created directories or result]
+            if (message->ioctl.length_in < 12 || message->ioctl.length_io < 4) {
+                res = IOS_ERROR_INVALID_SIZE;
+            } else {
+                int fd     = message->ioctl.buffer_in[0];
+                char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+                u32 mode   = message->ioctl.buffer_in[2];
+
+                message->ioctl.buffer_io[0] = fsa_tree_make_dirs(fd, path, mode);
+            }
+            break;
+        }
+#endif
+
+        default:
+            res = IOS_ERROR_INVALID_ARG;
+            break;
+    }
+
+    return res;
+}
+
+#ifdef MOCHA_FSA_IOCTLV
+// Starts the transfer of an ioctlv request with FSA's async ioctlv, ipc_completion_thread replies once it is done.
+// Returns 0 if the request was not started, it is then handled synchronously.
+static int ipc_defer(ipcmessage *message, u32 *args, void *data, int raw, int write, int withPos) {
+    FSAAsyncRequest *request;
+    if (deferredFreeQueueId < 0 || svcReceiveMessage(deferredFreeQueueId, (ipcmessage **) &request, IPC_NOBLOCK) < 0) {
+        return 0;
+    }
+
+    int res;
+    request->userdata = message;
+    if (raw) {
+        res = FSA_RawReadWriteAsync(args[0], data, args[1], args[2], ((u64) args[3] << 32ULL) | args[4], args[5], !write, completionQueueId, request);
+    } else if (withPos) {
+        res = FSA_ReadWriteFileWithPosAsync(args[0], data, args[1], args[2], args[3], args[4], args[5], !write, completionQueueId, request);
+    } else {
+        res = FSA_ReadWriteFileWithPosAsync(args[0], data, args[1], args[2], 0, args[3], args[4], !write, completionQueueId, request);
+    }
+
+    if (res < 0) {
+        svcSendMessage(deferredFreeQueueId, (u32) request, 0);
+        return 0;
+    }
+    return 1;
+}
+
+static int ipc_completion_thread(void *arg) {
+    FSAAsyncRequest *request;
+
+    while (1) {
+        if (svcReceiveMessage(completionQueueId, (ipcmessage **) &request, 0) < 0) {
+            usleep(10000);
+            continue;
+        }
+        int res             = FSA_FinishAsync(request);
+        ipcmessage *message = (ipcmessage *) request->userdata;
+        u32 fd              = message->fd;
+        svcResourceReply(message, res);
+        session_end_request(fd);
+        svcSendMessage(deferredFreeQueueId, (u32) request, 0);
+    }
+    return 0;
+}
+
+static void ipc_start_completion(void) {
+    completionQueueId   = -1;
+    deferredFreeQueueId = -1;
+
+    FSAAsyncRequest *requests = (FSAAsyncRequest *) heap_alloc(sizeof(FSAAsyncRequest) * IPC_MAX_DEFERRED);
+    u8 *stack                 = (u8 *) heap_alloc_align(IPC_WORKER_STACK_SIZE, 0x20);
+    if (!requests || !stack) {
+        return;
+    }
+
+    completionQueueId = svcCreateMessageQueue(completionQueue, IPC_MAX_DEFERRED);
+    int freeQueueId   = svcCreateMessageQueue(deferredFreeQueue, IPC_MAX_DEFERRED);
+    if (completionQueueId < 0 || freeQueueId < 0) {
+        return;
+    }
+    for (u32 i = 0; i < IPC_MAX_DEFERRED; i++) {
+        svcSendMessage(freeQueueId, (u32) &requests[i], 0);
+    }
+
+    int threadId = svcCreateThread(ipc_completion_thread, 0, (u32 *) (stack + IPC_WORKER_STACK_SIZE), IPC_WORKER_STACK_SIZE, 0x78, 1);
+    if (threadId >= 0) {
+        svcStartThread(threadId);
+        deferredFreeQueueId = freeQueueId;
+    }
+}
+
+// ioctlv variants of the FSA data commands, the data is a vector of its own and used in place
+// instead of being copied to and from offset 0x40 of the ioctl buffers. The arguments are the
+// same words as for the ioctl and the FSA result is the reply value. The transfer runs in the
+// background when possible, *deferred is then set and the reply is sent once it is done.
+// reads:  in = [arguments], io = [data]
+// writes: in = [arguments][data]
+int ipc_ioctlv(ipcmessage *message, int *deferred) {
+    iovec_s *vector = message->ioctlv.vector;
+    u32 num_in      = message->ioctlv.num_in;
+    u32 num_io      = message->ioctlv.num_io;
+    u32 num_args    = 6;
+    int write;
+
+    switch (message->ioctlv.command) {
+        case IOCTL_FSA_READFILE:
+            num_args = 5;
+            // fallthrough
+        case IOCTL_FSA_READFILEWITHPOS:
+        case IOCTL_FSA_RAW_READ:
+            write = 0;
+            break;
+        case IOCTL_FSA_WRITEFILE:
+            num_args = 5;
+            // fallthrough
+        case IOCTL_FSA_WRITEFILEWITHPOS:
+        case IOCTL_FSA_RAW_WRITE:
+            write = 1;
+            break;
+        default:
+            return IOS_ERROR_INVALID_ARG;
+    }
+
+    if (num_in != 1 + write || num_io != 1 - write || vector[0].len < num_args * 4) {
+        return IOS_ERROR_INVALID_SIZE;
+    }
+
+    u32 *args  = (u32 *) vector[0].ptr;
+    void *data = vector[1].ptr;
+    if ((u64) args[1] * args[2] > vector[1].len) {
+        return IOS_ERROR_INVALID_SIZE;
+    }
+
+    int raw     = message->ioctlv.command == IOCTL_FSA_RAW_READ || message->ioctlv.command == IOCTL_FSA_RAW_WRITE;
+    int withPos = message->ioctlv.command == IOCTL_FSA_READFILEWITHPOS || message->ioctlv.command == IOCTL_FSA_WRITEFILEWITHPOS;
+    if (!raw) {
+        // buffered writes are flushed before every transfer, only reads at an explicit position keep the file position
+        u32 syncFlags = write ? FILECACHE_SYNC_DROP : (withPos ? 0 : FILECACHE_SYNC_SEEK);
+        filecache_sync(args[0], withPos ? args[4] : args[3], syncFlags);
+        if (write) {
+            statcache_file_changed(args[0], withPos ? args[4] : args[3], 0);
+            filecache_file_changed(args[0], withPos ? args[4] : args[3]);
+        }
+    }
+    if (ipc_defer(message, args, data, raw, write, withPos)) {
+        *deferred = 1;
+        return 0;
+    }
+
+    u64 sector_offset = ((u64) args[3] << 32ULL) | args[4];
+    switch (message->ioctlv.command) {
+        case IOCTL_FSA_READFILE:
+            return FSA_ReadFile(args[0], data, args[1], args[2], args[3], args[4]);
+        case IOCTL_FSA_WRITEFILE:
+            return FSA_WriteFile(args[0], data, args[1], args[2], args[3], args[4]);
+        case IOCTL_FSA_READFILEWITHPOS:
+            return FSA_ReadFileWithPos(args[0], data, args[1], args[2], args[3], args[4], args[5]);
+        case IOCTL_FSA_WRITEFILEWITHPOS:
+            return FSA_WriteFileWithPos(args[0], data, args[1], args[2], args[3], args[4], args[5]);
+        case IOCTL_FSA_RAW_READ:
+            return FSA_RawRead(args[0], data, args[1], args[2], sector_offset, args[5]);
+        default:
+            return FSA_RawWrite(args[0], data, args[1], args[2], sector_offset, args[5]);
+    }
+}
+#endif
+
+#ifdef MOCHA_RING
+// Requests from the shared-memory ring run on the ring thread, which must not stop itself.
+static int ipc_ring_ioctl(ipcmessage *message) {
+    switch (message->ioctl.command) {
+        case IOCTL_KILL_SERVER:
+        case IOCTL_RING_SETUP:
+        case IOCTL_RING_DOORBELL:
+            return IOS_ERROR_INVALID_ARG;
+        default:
+            return ipc_ioctl(message);
+    }
+}
+
+#endif
+#ifdef MOCHA_IPC_LANES
+static int ipc_worker(void *arg) {
+    int queueId = (int) arg;
+    ipcmessage *message;
+
+    while (1) {
+        if (svcReceiveMessage(queueId, &message, 0) < 0) {
+            usleep(10000);
+            continue;
+        }
+        ipc_handle(message);
+    }
+    return 0;
+}
+
+static int ipc_start_workers(int queueId, u32 count) {
+    u32 started = 0;
+    for (u32 i = 0; i < count; i++) {
+        u8 *stack = (u8 *) heap_alloc_align(IPC_WORKER_STACK_SIZE, 0x20);
+        if (!stack) {
+            break;
+        }
+        int threadId = svcCreateThread(ipc_worker, (void *) queueId, (u32 *) (stack + IPC_WORKER_STACK_SIZE), IPC_WORKER_STACK_SIZE, 0x78, 1);
+        if (threadId < 0) {
+            heap_free(stack);
+            break;
+        }
+        svcStartThread(threadId);
+        started++;
+    }
+    return started ? queueId : -1;
+}
+
+// Memory commands go to the fast lane, everything that does I/O or works on large
+// ranges to the slow lane, so a slow FSA call does not hold up memory accesses.
+// IOCTL_SVC may block in the called syscall and IOCTL_REPEATED_WRITE loops for a
+// client chosen count, both would stall the single fast worker.
+static int ipc_is_slow(ipcmessage *message) {
+    if (message->command == IOS_IOCTLV) {
+        return 1;
+    }
+    switch (message->ioctl.command) {
+        case IOCTL_SVC:
+        case IOCTL_REPEATED_WRITE:
+        case IOCTL_MEM_SNAPSHOT:
+        case IOCTL_MEM_DIFF:
+        case IOCTL_MEM_SEARCH:
+            return 1;
+        case IOCTL_CHECK_IF_IOSUHAX:
+            return 0;
+        default:
+            return message->ioctl.command >= IOCTL_FSA_OPEN;
+    }
+}
+
+int ipc_lanes_queue(ipcmessage *message) {
+    int laneQueueId = ipc_is_slow(message) ? slowQueueId : fastQueueId;
+    if ((message->command == IOS_IOCTL && message->ioctl.command == IOCTL_KILL_SERVER) || laneQueueId < 0) {
+        return 0;
+    }
+    svcSendMessage(laneQueueId, (u32) message, 0);
+    return 1;
+}
+#endif
+
+void ipc_ext_init(void) {
+    session_init();
+    statcache_init();
+#ifdef MOCHA_FSA_TOOLS
+    fsa_tree_init();
+    hash_init();
+#endif
+    filecache_init();
+#ifdef MOCHA_RING
+    ring_init(ipc_ring_ioctl);
+#endif
+#ifdef MOCHA_FSA_IOCTLV
+    ipc_start_completion();
+#endif
+
+#ifdef MOCHA_IPC_LANES
+    // without workers a lane is served by the IPC thread
+    fastQueueId = svcCreateMessageQueue(fastQueue, IPC_QUEUE_SIZE);
+    slowQueueId = svcCreateMessageQueue(slowQueue, IPC_QUEUE_SIZE);
+    if (fastQueueId >= 0) {
+        fastQueueId = ipc_start_workers(fastQueueId, IPC_FAST_WORKERS);
+    }
+    if (slowQueueId >= 0) {
+        slowQueueId = ipc_start_workers(slowQueueId, IPC_SLOW_WORKERS);
+    }
+#endif
+}
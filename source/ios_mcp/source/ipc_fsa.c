@@ -0,0 +1,450 @@
+#include "filecache.h"
+#include "fsa.h"
+#include "ipc.h"
+#include "session.h"
+#include "statcache.h"
+
+// The FSA commands of ipc_ioctl. With any optional feature enabled this file is linked into the
+// extension region together with fsa.c and the caches it calls, see the Makefile.
+int ipc_fsa_ioctl(ipcmessage *message) {
+    int res = 0;
+
+    switch (message->ioctl.command) {
+            //!--------------------------------------------------------------------------------------------------------------
+            //! FSA handles for better performance
+            //!--------------------------------------------------------------------------------------------------------------
+            //! TODO: add checks for i/o buffer length
+        case IOCTL_FSA_OPEN: {
+            message->ioctl.buffer_io[0] = session_fsa_open(message->fd);
+            break;
+        }
+        case IOCTL_FSA_CLOSE: {
+            int fd                      = message->ioctl.buffer_in[0];
+            message->ioctl.buffer_io[0] = session_fsa_close(message->fd, fd);
+            break;
+        }
+        case IOCTL_FSA_MOUNT: {
+            int fd             = message->ioctl.buffer_in[0];
+            char *device_path  = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            char *volume_path  = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[2];
+            u32 flags          = message->ioctl.buffer_in[3];
+            char *arg_string   = (message->ioctl.buffer_in[4] > 0) ? (((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[4]) : 0;
+            int arg_string_len = message->ioctl.buffer_in[5];
+
+            message->ioctl.buffer_io[0] = FSA_Mount(fd, device_path, volume_path, flags, arg_string, arg_string_len);
+            statcache_invalidate_all();
+            filecache_invalidate_all();
+            break;
+        }
+        case IOCTL_FSA_UNMOUNT: {
+            int fd            = message->ioctl.buffer_in[0];
+            char *device_path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            u32 flags         = message->ioctl.buffer_in[2];
+
+            message->ioctl.buffer_io[0] = FSA_Unmount(fd, device_path, flags);
+            statcache_invalidate_all();
+            filecache_invalidate_all();
+            break;
+        }
+        case IOCTL_FSA_GETINFO: {
+            int fd            = message->ioctl.buffer_in[0];
+            char *device_path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            int type          = message->ioctl.buffer_in[2];
+
+            if (type == 5) {
+                message->ioctl.buffer_io[0] = statcache_get_stat(fd, device_path, (FSStat *) (message->ioctl.buffer_io + 1));
+            } else {
+                message->ioctl.buffer_io[0] = FSA_GetInfo(fd, device_path, type, message->ioctl.buffer_io + 1);
+            }
+            break;
+        }
+        case IOCTL_FSA_OPENDIR: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_OpenDir(fd, path, (int *) message->ioctl.buffer_io + 1);
+            if ((int) message->ioctl.buffer_io[0] >= 0) {
+                session_add_handle(message->fd, fd, message->ioctl.buffer_io[1], SESSION_HANDLE_DIR);
+            }
+            break;
+        }
+        case IOCTL_FSA_READDIR: {
+            int fd     = message->ioctl.buffer_in[0];
+            int handle = message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_ReadDir(fd, handle, (FSDirectory *) (message->ioctl.buffer_io + 1));
+            break;
+        }
+        case IOCTL_FSA_CLOSEDIR: {
+            int fd     = message->ioctl.buffer_in[0];
+            int handle = message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_CloseDir(fd, handle);
+            session_remove_handle(message->fd, fd, handle);
+            break;
+        }
+        case IOCTL_FSA_MAKEDIR: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            u32 flags  = message->ioctl.buffer_in[2];
+
+            message->ioctl.buffer_io[0] = FSA_MakeDir(fd, path, flags);
+            statcache_invalidate_path(path);
+            break;
+        }
+        case IOCTL_FSA_OPENFILE: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            char *mode = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[2];
+
+            message->ioctl.buffer_io[0] = FSA_OpenFile(fd, path, mode, (int *) (message->ioctl.buffer_io + 1));
+            if ((int) message->ioctl.buffer_io[0] >= 0) {
+                statcache_open_file(fd, message->ioctl.buffer_io[1], path, mode);
+                filecache_open_file(path, mode);
+                session_add_handle(message->fd, fd, message->ioctl.buffer_io[1], SESSION_HANDLE_FILE);
+            }
+            break;
+        }
+        case IOCTL_FSA_READFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            u32 size       = message->ioctl.buffer_in[1];
+            u32 cnt        = message->ioctl.buffer_in[2];
+            int fileHandle = message->ioctl.buffer_in[3];
+            u32 flags      = message->ioctl.buffer_in[4];
+
+            message->ioctl.buffer_io[0] = filecache_read(fd, ((u8 *) message->ioctl.buffer_io) + 0x40, size, cnt, FILECACHE_CURRENT_POS, fileHandle, flags);
+            break;
+        }
+        case IOCTL_FSA_WRITEFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            u32 size       = message->ioctl.buffer_in[1];
+            u32 cnt        = message->ioctl.buffer_in[2];
+            int fileHandle = message->ioctl.buffer_in[3];
+            u32 flags      = message->ioctl.buffer_in[4];
+
+            message->ioctl.buffer_io[0] = filecache_write(fd, ((u8 *) message->ioctl.buffer_in) + 0x40, size, cnt, FILECACHE_CURRENT_POS, fileHandle, flags);
+            statcache_file_changed(fd, fileHandle, 0);
+            filecache_file_changed(fd, fileHandle);
+            break;
+        }
+        case IOCTL_FSA_GETSTATFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            int fileHandle = message->ioctl.buffer_in[1];
+
+            filecache_sync(fd, fileHandle, 0);
+            message->ioctl.buffer_io[0] = FSA_GetStatFile(fd, fileHandle, (FSStat *) (message->ioctl.buffer_io + 1));
+            break;
+        }
+        case IOCTL_FSA_CLOSEFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            int fileHandle = message->ioctl.buffer_in[1];
+
+            int flushRes                = filecache_sync(fd, fileHandle, FILECACHE_SYNC_CLOSE);
+            message->ioctl.buffer_io[0] = FSA_CloseFile(fd, fileHandle);
+            if (flushRes < 0) {
+                message->ioctl.buffer_io[0] = flushRes;
+            }
+            statcache_file_changed(fd, fileHandle, 1);
+            session_remove_handle(message->fd, fd, fileHandle);
+            break;
+        }
+        case IOCTL_FSA_SETPOSFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            int fileHandle = message->ioctl.buffer_in[1];
+            u32 position   = message->ioctl.buffer_in[2];
+
+            filecache_sync(fd, fileHandle, FILECACHE_SYNC_SEEK);
+            message->ioctl.buffer_io[0] = FSA_SetPosFile(fd, fileHandle, position);
+            break;
+        }
+        case IOCTL_FSA_GETSTAT: {
+            int fd            = message->ioctl.buffer_in[0];
+            char *device_path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = statcache_get_stat(fd, device_path, (FSStat *) (message->ioctl.buffer_io + 1));
+            break;
+        }
+        case IOCTL_FSA_REMOVE: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_Remove(fd, path);
+            statcache_invalidate_path(path);
+            filecache_invalidate_path(path);
+            break;
+        }
+        case IOCTL_FSA_REWINDDIR: {
+            int fd     = message->ioctl.buffer_in[0];
+            int handle = message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_RewindDir(fd, handle);
+            break;
+        }
+        case IOCTL_FSA_CHDIR: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_ChangeDir(fd, path);
+            break;
+        }
+        case IOCTL_FSA_RENAME: {
+            int fd         = message->ioctl.buffer_in[0];
+            char *old_path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            char *new_path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[2];
+
+            message->ioctl.buffer_io[0] = FSA_Rename(fd, old_path, new_path);
+            statcache_invalidate_path(old_path);
+            statcache_invalidate_path(new_path);
+            filecache_invalidate_path(old_path);
+            filecache_invalidate_path(new_path);
+            break;
+        }
+        case IOCTL_FSA_RAW_OPEN: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_RawOpen(fd, path, (int *) (message->ioctl.buffer_io + 1));
+            if ((int) message->ioctl.buffer_io[0] >= 0) {
+                session_add_handle(message->fd, fd, message->ioctl.buffer_io[1], SESSION_HANDLE_RAW);
+            }
+            break;
+        }
+        case IOCTL_FSA_RAW_READ: {
+            int fd            = message->ioctl.buffer_in[0];
+            u32 block_size    = message->ioctl.buffer_in[1];
+            u32 cnt           = message->ioctl.buffer_in[2];
+            u64 sector_offset = ((u64) message->ioctl.buffer_in[3] << 32ULL) | message->ioctl.buffer_in[4];
+            int deviceHandle  = message->ioctl.buffer_in[5];
+
+            message->ioctl.buffer_io[0] = FSA_RawRead(fd, ((u8 *) message->ioctl.buffer_io) + 0x40, block_size, cnt, sector_offset, deviceHandle);
+            break;
+        }
+        case IOCTL_FSA_RAW_WRITE: {
+            int fd            = message->ioctl.buffer_in[0];
+            u32 block_size    = message->ioctl.buffer_in[1];
+            u32 cnt           = message->ioctl.buffer_in[2];
+            u64 sector_offset = ((u64) message->ioctl.buffer_in[3] << 32ULL) | message->ioctl.buffer_in[4];
+            int deviceHandle  = message->ioctl.buffer_in[5];
+
+            message->ioctl.buffer_io[0] = FSA_RawWrite(fd, ((u8 *) message->ioctl.buffer_in) + 0x40, block_size, cnt, sector_offset, deviceHandle);
+            break;
+        }
+        case IOCTL_FSA_RAW_CLOSE: {
+            int fd           = message->ioctl.buffer_in[0];
+            int deviceHandle = message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_RawClose(fd, deviceHandle);
+            session_remove_handle(message->fd, fd, deviceHandle);
+            break;
+        }
+        case IOCTL_FSA_CHANGEMODE: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            int mode   = message->ioctl.buffer_in[2];
+
+            message->ioctl.buffer_io[0] = FSA_ChangeMode(fd, path, mode);
+            statcache_invalidate_path(path);
+            break;
+        }
+        case IOCTL_FSA_FLUSHVOLUME: {
+            int fd            = message->ioctl.buffer_in[0];
+            char *device_path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_FlushVolume(fd, device_path);
+            break;
+        }
+        case IOCTL_FSA_CHANGEOWNER: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            u32 owner  = message->ioctl.buffer_in[2];
+            u32 group  = message->ioctl.buffer_in[3];
+
+            message->ioctl.buffer_io[0] = FSA_ChangeOwner(fd, path, owner, group);
+            statcache_invalidate_path(path);
+            break;
+        }
+        case IOCTL_FSA_OPENFILEEX: {
+            int fd                = message->ioctl.buffer_in[0];
+            char *path            = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            char *mode            = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[2];
+            u32 flags             = message->ioctl.buffer_in[3];
+            int create_mode       = message->ioctl.buffer_in[4];
+            u32 create_alloc_size = message->ioctl.buffer_in[5];
+
+            message->ioctl.buffer_io[0] = FSA_OpenFileEx(fd, path, mode, flags, create_mode, create_alloc_size, (int *) (message->ioctl.buffer_io + 1));
+            if ((int) message->ioctl.buffer_io[0] >= 0) {
+                statcache_open_file(fd, message->ioctl.buffer_io[1], path, mode);
+                filecache_open_file(path, mode);
+                session_add_handle(message->fd, fd, message->ioctl.buffer_io[1], SESSION_HANDLE_FILE);
+            }
+            break;
+        }
+        case IOCTL_FSA_READFILEWITHPOS: {
+            int fd         = message->ioctl.buffer_in[0];
+            u32 size       = message->ioctl.buffer_in[1];
+            u32 cnt        = message->ioctl.buffer_in[2];
+            u32 pos        = message->ioctl.buffer_in[3];
+            int fileHandle = message->ioctl.buffer_in[4];
+            u32 flags      = message->ioctl.buffer_in[5];
+
+            message->ioctl.buffer_io[0] = filecache_read(fd, ((u8 *) message->ioctl.buffer_io) + 0x40, size, cnt, pos, fileHandle, flags);
+            break;
+        }
+        case IOCTL_FSA_WRITEFILEWITHPOS: {
+            int fd         = message->ioctl.buffer_in[0];
+            u32 size       = message->ioctl.buffer_in[1];
+            u32 cnt        = message->ioctl.buffer_in[2];
+            u32 pos        = message->ioctl.buffer_in[3];
+            int fileHandle = message->ioctl.buffer_in[4];
+            u32 flags      = message->ioctl.buffer_in[5];
+
+            message->ioctl.buffer_io[0] = filecache_write(fd, ((u8 *) message->ioctl.buffer_in) + 0x40, size, cnt, pos, fileHandle, flags);
+            statcache_file_changed(fd, fileHandle, 0);
+            filecache_file_changed(fd, fileHandle);
+            break;
+        }
+        case IOCTL_FSA_APPENDFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            u32 size       = message->ioctl.buffer_in[1];
+            u32 cnt        = message->ioctl.buffer_in[2];
+            int fileHandle = message->ioctl.buffer_in[3];
+
+            filecache_sync(fd, fileHandle, FILECACHE_SYNC_DROP);
+            message->ioctl.buffer_io[0] = FSA_AppendFile(fd, size, cnt, fileHandle);
+            statcache_file_changed(fd, fileHandle, 0);
+            filecache_file_changed(fd, fileHandle);
+            break;
+        }
+        case IOCTL_FSA_APPENDFILEEX: {
+            int fd         = message->ioctl.buffer_in[0];
+            u32 size       = message->ioctl.buffer_in[1];
+            u32 cnt        = message->ioctl.buffer_in[2];
+            int fileHandle = message->ioctl.buffer_in[3];
+            u32 flags      = message->ioctl.buffer_in[4];
+
+            filecache_sync(fd, fileHandle, FILECACHE_SYNC_DROP);
+            message->ioctl.buffer_io[0] = FSA_AppendFileEx(fd, size, cnt, fileHandle, flags);
+            statcache_file_changed(fd, fileHandle, 0);
+            filecache_file_changed(fd, fileHandle);
+            break;
+        }
+        case IOCTL_FSA_FLUSHFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            int fileHandle = message->ioctl.buffer_in[1];
+
+            int flushRes                = filecache_sync(fd, fileHandle, FILECACHE_SYNC_FLUSH);
+            message->ioctl.buffer_io[0] = FSA_FlushFile(fd, fileHandle);
+            if (flushRes < 0) {
+                message->ioctl.buffer_io[0] = flushRes;
+            }
+            break;
+        }
+        case IOCTL_FSA_TRUNCATEFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            int fileHandle = message->ioctl.buffer_in[1];
+
+            filecache_sync(fd, fileHandle, FILECACHE_SYNC_DROP);
+            message->ioctl.buffer_io[0] = FSA_TruncateFile(fd, fileHandle);
+            statcache_file_changed(fd, fileHandle, 0);
+            filecache_file_changed(fd, fileHandle);
+            break;
+        }
+        case IOCTL_FSA_GETPOSFILE: {
+            int fd         = message->ioctl.buffer_in[0];
+            int fileHandle = message->ioctl.buffer_in[1];
+
+            filecache_sync(fd, fileHandle, 0);
+            message->ioctl.buffer_io[0] = FSA_GetPosFile(fd, fileHandle, (u32 *) (message->ioctl.buffer_io + 1));
+            break;
+        }
+        case IOCTL_FSA_ISEOF: {
+            int fd         = message->ioctl.buffer_in[0];
+            int fileHandle = message->ioctl.buffer_in[1];
+
+            filecache_sync(fd, fileHandle, 0);
+            message->ioctl.buffer_io[0] = FSA_IsEof(fd, fileHandle);
+            break;
+        }
+        case IOCTL_FSA_ROLLBACKVOLUME: {
+            int fd            = message->ioctl.buffer_in[0];
+            char *device_path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_RollbackVolume(fd, device_path);
+            statcache_invalidate_all();
+            filecache_invalidate_all();
+            break;
+        }
+        case IOCTL_FSA_GETCWD: {
+            int fd          = message->ioctl.buffer_in[0];
+            int output_size = message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_GetCwd(fd, (char *) (message->ioctl.buffer_io + 1), output_size);
+            break;
+        }
+        case IOCTL_FSA_MAKEQUOTA: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            u32 flags  = message->ioctl.buffer_in[2];
+            u64 size   = ((u64) message->ioctl.buffer_in[3] << 32ULL) | message->ioctl.buffer_in[4];
+
+            message->ioctl.buffer_io[0] = FSA_MakeQuota(fd, path, flags, size);
+            statcache_invalidate_path(path);
+            break;
+        }
+        case IOCTL_FSA_FLUSHQUOTA: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_FlushQuota(fd, path);
+            break;
+        }
+        case IOCTL_FSA_ROLLBACKQUOTA: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_RollbackQuota(fd, path);
+            statcache_invalidate_all();
+            filecache_invalidate_all();
+            break;
+        }
+        case IOCTL_FSA_ROLLBACKQUOTAFORCE: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_RollbackQuotaForce(fd, path);
+            statcache_invalidate_all();
+            filecache_invalidate_all();
+            break;
+        }
+        case IOCTL_FSA_CHANGEMODEEX: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+            int mode   = message->ioctl.buffer_in[2];
+            int mask   = message->ioctl.buffer_in[3];
+
+            message->ioctl.buffer_io[0] = FSA_ChangeModeEx(fd, path, mode, mask);
+            statcache_invalidate_path(path);
+            break;
+        }
+        case IOCTL_FSA_REGISTERFLUSHQUOTA: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_RegisterFlushQuota(fd, path);
+            break;
+        }
+        case IOCTL_FSA_FLUSHMULTIQUOTA: {
+            int fd     = message->ioctl.buffer_in[0];
+            char *path = ((char *) message->ioctl.buffer_in) + message->ioctl.buffer_in[1];
+
+            message->ioctl.buffer_io[0] = FSA_FlushMultiQuota(fd, path);
+            break;
+        }
+
+        default:
+            res = ipc_ext_ioctl(message);
+            break;
+    }
+
+    return res;
+}
@@ -19,8 +19,20 @@
 #define IOS_RESUME          0x0D
 #define IOS_SVCMSG          0x0E
 
+#define IOS_ERROR_UNKNOWN_VALUE 0xFFFFFFD6
+#define IOS_ERROR_INVALID_ARG   0xFFFFFFE3
+#define IOS_ERROR_INVALID_SIZE  0xFFFFFFE9
+#define IOS_ERROR_UNKNOWN       0xFFFFFFF7
+#define IOS_ERROR_NOEXISTS      0xFFFFFFFA
+
 
 /* IPC message */
+typedef struct {
+    void *ptr;
+    u32 len;
+    u32 unk;
+} iovec_s;
+
 typedef struct ipcmessage {
     u32 command;
     u32 result;
@@ -58,12 +70,12 @@ typedef struct ipcmessage {
             u32 *buffer_io;
             u32 length_io;
         } ioctl;
-        struct _ioctlv {
+        struct {
             u32 command;
 
             u32 num_in;
             u32 num_io;
-            struct _ioctlv *vector;
+            iovec_s *vector;
         } ioctlv;
     };
 
@@ -1,4 +1,8 @@
+#include "heap.h"
 #include "ipc.h"
+#include "memsnap.h"
+#include "slab.h"
+#include "watch.h"
 #include "wupserver.h"
 
 static int threadsStarted = 0;
@@ -7,6 +11,15 @@ int _startMainThread(void) {
     if (threadsStarted == 0) {
         threadsStarted = 1;
 
+        heap_init();
+        slab_init();
+#ifdef MOCHA_MEMTOOLS
+        memsnap_init();
+#endif
+#ifdef MOCHA_WATCH
+        watch_init();
+#endif
+
         wupserver_init();
         ipc_init();
     }
@@ -0,0 +1,148 @@
+#include "memsearch.h"
+#include "ipc_types.h"
+#include "svc.h"
+
+static int memsearch_verify(const u8 *data, const u8 *pattern, const u8 *mask, u32 length) {
+    for (u32 i = 0; i < length; i++) {
+        if ((data[i] ^ pattern[i]) & mask[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Looks for one fully masked byte of the pattern a whole word at a time, using the
+// "has zero byte" trick on word ^ anchor, and only verifies the pattern at hits.
+static u32 memsearch_pattern(const MemSearchParams *p, u32 *results, u32 max_results, u32 *next_address) {
+    const u8 *pattern = p->pattern;
+    const u8 *mask    = p->pattern + p->pattern_length;
+    u32 length        = p->pattern_length;
+    u32 last          = p->end - length; // last possible match address
+    u32 count         = 0;
+
+    u32 anchor = 0;
+    while (anchor < length && mask[anchor] != 0xFF) {
+        anchor++;
+    }
+
+    if (anchor == length) {
+        // no byte is fully masked, so there is nothing to scan for
+        for (u32 addr = p->start; addr <= last; addr++) {
+            if (memsearch_verify((const u8 *) addr, pattern, mask, length)) {
+                results[count++] = addr;
+                if (count == max_results) {
+                    *next_address = addr + 1;
+                    return count;
+                }
+            }
+        }
+        return count;
+    }
+
+    u32 repeated      = pattern[anchor] * 0x01010101;
+    const u32 *word   = (const u32 *) ((p->start + anchor) & ~3);
+    const u32 *lastWd = (const u32 *) ((last + anchor) & ~3);
+
+    for (; word <= lastWd; word++) {
+        u32 v = *word ^ repeated;
+        if (!((v - 0x01010101) & ~v & 0x80808080)) {
+            continue;
+        }
+        for (u32 b = 0; b < 4; b++) {
+            u32 addr = (u32) word + b - anchor;
+            if (addr < p->start || addr > last) {
+                continue;
+            }
+            if (memsearch_verify((const u8 *) addr, pattern, mask, length)) {
+                results[count++] = addr;
+                if (count == max_results) {
+                    *next_address = addr + 1;
+                    return count;
+                }
+            }
+        }
+    }
+    return count;
+}
+
+// The ARM926 has no branch prediction and loads stall, so four words are loaded per
+// iteration (a single ldm) and only a group containing a match is looked at word by word.
+#define MEMSEARCH_WORD_LOOP(MATCH)                                              \
+    while (word < end) {                                                        \
+        if (word + 4 <= end) {                                                  \
+            u32 w0 = word[0], w1 = word[1], w2 = word[2], w3 = word[3];         \
+            if (!(MATCH(w0) || MATCH(w1) || MATCH(w2) || MATCH(w3))) {          \
+                word += 4;                                                      \
+                continue;                                                       \
+            }                                                                   \
+        }                                                                       \
+        for (u32 n = (word + 4 <= end) ? 4 : 1; n > 0; n--, word++) {           \
+            if (MATCH(*word)) {                                                 \
+                results[count++] = (u32) word;                                  \
+                if (count == max_results) {                                     \
+                    *next_address = (u32) (word + 1);                           \
+                    return count;                                               \
+                }                                                               \
+            }                                                                   \
+        }                                                                       \
+    }
+
+static u32 memsearch_u32(const MemSearchParams *p, u32 *results, u32 max_results, u32 *next_address) {
+    const u32 *word = (const u32 *) ((p->start + 3) & ~3);
+    const u32 *end  = (const u32 *) (p->end & ~3);
+    u32 value       = p->value & p->value2;
+    u32 mask        = p->value2;
+    u32 count       = 0;
+
+#define MATCH_U32(w) ((((w) & mask) == value))
+    MEMSEARCH_WORD_LOOP(MATCH_U32)
+#undef MATCH_U32
+    return count;
+}
+
+static u32 memsearch_range(const MemSearchParams *p, u32 *results, u32 max_results, u32 *next_address) {
+    const u32 *word = (const u32 *) ((p->start + 3) & ~3);
+    const u32 *end  = (const u32 *) (p->end & ~3);
+    u32 min         = p->value;
+    u32 span        = p->value2 - p->value;
+    u32 count       = 0;
+
+    // min <= w <= max as a single unsigned compare
+#define MATCH_RANGE(w) (((w) -min) <= span)
+    MEMSEARCH_WORD_LOOP(MATCH_RANGE)
+#undef MATCH_RANGE
+    return count;
+}
+
+int memsearch_run(const MemSearchParams *params, u32 *results, u32 max_results, u32 *next_address) {
+    if (params->max_results < max_results) {
+        max_results = params->max_results;
+    }
+    if (params->end <= params->start || max_results == 0) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+
+    *next_address = params->end;
+
+    if (params->flags & MEMSEARCH_FLAG_INVALIDATE) {
+        svcInvalidateDCache((void *) params->start, params->end - params->start);
+    }
+
+    switch (params->mode) {
+        case MEMSEARCH_MODE_PATTERN:
+            if (params->pattern_length == 0 || params->pattern_length > MEMSEARCH_MAX_PATTERN_SIZE ||
+                params->pattern_length > params->end - params->start) {
+                return IOS_ERROR_INVALID_ARG;
+            }
+            return memsearch_pattern(params, results, max_results, next_address);
+        case MEMSEARCH_MODE_U32:
+            return memsearch_u32(params, results, max_results, next_address);
+        case MEMSEARCH_MODE_RANGE:
+            if (params->value2 < params->value) {
+                return IOS_ERROR_INVALID_ARG;
+            }
+            return memsearch_range(params, results, max_results, next_address);
+        default:
+            return IOS_ERROR_INVALID_ARG;
+    }
+}
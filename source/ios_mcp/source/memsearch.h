@@ -0,0 +1,31 @@
+#ifndef MEMSEARCH_H
+#define MEMSEARCH_H
+
+#include "types.h"
+
+#define MEMSEARCH_MODE_PATTERN     0 // byte pattern with a per byte mask, any alignment
+#define MEMSEARCH_MODE_U32         1 // aligned u32 where (word & mask) == value
+#define MEMSEARCH_MODE_RANGE       2 // aligned u32 where min <= word <= max
+
+#define MEMSEARCH_FLAG_INVALIDATE  0x01 // invalidate the data cache for the range first
+
+#define MEMSEARCH_MAX_PATTERN_SIZE 0x40
+
+typedef struct MemSearchParams {
+    u32 mode;
+    u32 flags;
+    u32 start;
+    u32 end; // exclusive
+    u32 max_results;
+    u32 value;          // U32: value,  RANGE: min
+    u32 value2;         // U32: mask,   RANGE: max
+    u32 pattern_length; // PATTERN: length of pattern and of mask
+    u8 pattern[];       // PATTERN: pattern bytes followed by the mask bytes, mask bits that are set have to match
+} MemSearchParams;
+
+// Scans [start, end) and stores up to max_results match addresses in results.
+// next_address is set to where a follow-up search has to start, which is end once the range is done.
+// Returns the number of matches or a negative error.
+int memsearch_run(const MemSearchParams *params, u32 *results, u32 max_results, u32 *next_address);
+
+#endif
@@ -0,0 +1,126 @@
+#include "memsnap.h"
+#include "heap.h"
+#include "imports.h"
+#include "ipc_types.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+typedef struct {
+    u32 address;
+    u32 size;
+    u32 *data;
+} MemSnapSlot;
+
+static MemSnapSlot slots[MEMSNAP_MAX_SLOTS];
+static mutex_t slotsMutex;
+
+void memsnap_init(void) {
+    mutex_init(&slotsMutex);
+}
+
+static void memsnap_free_slot(MemSnapSlot *slot) {
+    if (slot->data) {
+        heap_free(slot->data);
+    }
+    slot->data    = NULL;
+    slot->size    = 0;
+    slot->address = 0;
+}
+
+int memsnap_take(u32 slot, u32 address, u32 size, u32 flags) {
+    if (slot >= MEMSNAP_MAX_SLOTS || (address & 3)) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+    size &= ~3;
+
+    int res = 0;
+    mutex_lock(&slotsMutex);
+
+    MemSnapSlot *s = &slots[slot];
+    if (s->size != size) {
+        memsnap_free_slot(s);
+        if (size) {
+            s->data = (u32 *) heap_alloc_align(size, 0x40);
+            if (!s->data) {
+                res = IOS_ERROR_UNKNOWN;
+            }
+        }
+    }
+
+    if (res >= 0 && size) {
+        if (flags & MEMSNAP_FLAG_INVALIDATE) {
+            svcInvalidateDCache((void *) address, size);
+        }
+        memcpy(s->data, (void *) address, size);
+        s->address = address;
+        s->size    = size;
+    }
+
+    mutex_unlock(&slotsMutex);
+    return res;
+}
+
+static int memsnap_match(u32 filter, u32 old, u32 cur) {
+    switch (filter) {
+        case MEMSNAP_FILTER_UNCHANGED:
+            return cur == old;
+        case MEMSNAP_FILTER_INCREASED:
+            return cur > old;
+        case MEMSNAP_FILTER_DECREASED:
+            return cur < old;
+        default:
+            return cur != old;
+    }
+}
+
+int memsnap_diff(u32 slot, u32 filter, u32 flags, u32 offset, void *out, u32 out_size, u32 *next_offset) {
+    if (slot >= MEMSNAP_MAX_SLOTS || filter > MEMSNAP_FILTER_DECREASED) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+
+    mutex_lock(&slotsMutex);
+
+    MemSnapSlot *s = &slots[slot];
+    if (!s->data) {
+        mutex_unlock(&slotsMutex);
+        return IOS_ERROR_NOEXISTS;
+    }
+
+    u32 *cur           = (u32 *) s->address;
+    u32 words          = s->size / 4;
+    u32 i              = (offset & ~3) / 4;
+    u32 used           = 0;
+    MemSnapRecord *rec = NULL;
+
+    for (; i < words; i++) {
+        u32 value = cur[i];
+        if (!memsnap_match(filter, s->data[i], value)) {
+            rec = NULL;
+        } else {
+            if (!rec) {
+                // a new record needs its header plus at least one word
+                if (used + sizeof(MemSnapRecord) + 4 > out_size) {
+                    break;
+                }
+                rec          = (MemSnapRecord *) ((u8 *) out + used);
+                rec->address = s->address + i * 4;
+                rec->length  = 0;
+                used += sizeof(MemSnapRecord);
+            } else if (used + 4 > out_size) {
+                break;
+            }
+            *(u32 *) &rec->data[rec->length] = value;
+            rec->length += 4;
+            used += 4;
+        }
+        if (flags & MEMSNAP_FLAG_UPDATE) {
+            s->data[i] = value;
+        }
+    }
+
+    *next_offset = i * 4;
+
+    mutex_unlock(&slotsMutex);
+    return used;
+}
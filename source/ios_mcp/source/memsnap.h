@@ -0,0 +1,37 @@
+#ifndef MEMSNAP_H
+#define MEMSNAP_H
+
+#include "types.h"
+
+#define MEMSNAP_MAX_SLOTS       4
+
+// snapshot flags
+#define MEMSNAP_FLAG_INVALIDATE 0x01 // invalidate the data cache for the region before reading it
+// diff flags
+#define MEMSNAP_FLAG_UPDATE     0x02 // store the current values in the snapshot after comparing
+
+// per u32 word filters of a diff
+#define MEMSNAP_FILTER_CHANGED   0
+#define MEMSNAP_FILTER_UNCHANGED 1
+#define MEMSNAP_FILTER_INCREASED 2
+#define MEMSNAP_FILTER_DECREASED 3
+
+// A diff is a list of records, each one is [addr][length][length bytes of current data]
+// with the data padded to a multiple of 4 bytes.
+typedef struct MemSnapRecord {
+    u32 address;
+    u32 length;
+    u8 data[];
+} MemSnapRecord;
+
+void memsnap_init(void);
+
+// Copies size bytes at address into a snapshot slot, a size of 0 frees the slot.
+int memsnap_take(u32 slot, u32 address, u32 size, u32 flags);
+
+// Compares the slot starting at offset bytes into it, fills out with records of the
+// words that match filter and stores the offset to continue at in next_offset.
+// Returns the number of bytes written to out or a negative error.
+int memsnap_diff(u32 slot, u32 filter, u32 flags, u32 offset, void *out, u32 out_size, u32 *next_offset);
+
+#endif
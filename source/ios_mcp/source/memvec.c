@@ -0,0 +1,60 @@
+#include "memvec.h"
+#include "ipc_types.h"
+#include "svc.h"
+#include <string.h>
+
+static int memvec_size(const MemVecEntry *entries, u32 count, u32 available) {
+    if (count > MEMVEC_MAX_ENTRIES) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+    u32 total = 0;
+    for (u32 i = 0; i < count; i++) {
+        if (entries[i].length > available - total) {
+            return IOS_ERROR_INVALID_SIZE;
+        }
+        total += entries[i].length;
+    }
+    return total;
+}
+
+int memvec_read(const MemVecEntry *entries, u32 count, void *out, u32 out_size) {
+    int res = memvec_size(entries, count, out_size);
+    if (res < 0) {
+        return res;
+    }
+
+    u8 *dst = (u8 *) out;
+    for (u32 i = 0; i < count; i++) {
+        const MemVecEntry *e = &entries[i];
+        if (e->flags & MEMVEC_FLAG_INVALIDATE) {
+            svcInvalidateDCache((void *) e->address, e->length);
+        }
+        memcpy(dst, (void *) e->address, e->length);
+        if (e->flags & MEMVEC_FLAG_FLUSH) {
+            svcFlushDCache((void *) e->address, e->length);
+        }
+        dst += e->length;
+    }
+    return res;
+}
+
+int memvec_write(const MemVecEntry *entries, u32 count, const void *data, u32 data_size) {
+    int res = memvec_size(entries, count, data_size);
+    if (res < 0) {
+        return res;
+    }
+
+    const u8 *src = (const u8 *) data;
+    for (u32 i = 0; i < count; i++) {
+        const MemVecEntry *e = &entries[i];
+        if (e->flags & MEMVEC_FLAG_INVALIDATE) {
+            svcInvalidateDCache((void *) e->address, e->length);
+        }
+        memcpy((void *) e->address, src, e->length);
+        if (e->flags & MEMVEC_FLAG_FLUSH) {
+            svcFlushDCache((void *) e->address, e->length);
+        }
+        src += e->length;
+    }
+    return res;
+}
@@ -0,0 +1,25 @@
+#ifndef MEMVEC_H
+#define MEMVEC_H
+
+#include "types.h"
+
+#define MEMVEC_MAX_ENTRIES     0x100
+
+#define MEMVEC_FLAG_INVALIDATE 0x01 // invalidate the data cache for the region before accessing it
+#define MEMVEC_FLAG_FLUSH      0x02 // flush the data cache for the region after accessing it
+
+typedef struct MemVecEntry {
+    u32 address;
+    u32 length;
+    u32 flags;
+} MemVecEntry;
+
+// Reads all regions into out, packed in the order of the entries without padding.
+// Returns the number of bytes written to out or a negative error.
+int memvec_read(const MemVecEntry *entries, u32 count, void *out, u32 out_size);
+
+// Writes the regions from data, packed the same way. Nothing is written when data is too short.
+// Returns the number of bytes taken from data or a negative error.
+int memvec_write(const MemVecEntry *entries, u32 count, const void *data, u32 data_size);
+
+#endif
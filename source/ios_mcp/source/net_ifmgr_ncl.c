@@ -1,5 +1,6 @@
 #include "net_ifmgr_ncl.h"
 #include "imports.h"
+#include "slab.h"
 #include "svc.h"
 #include <stdlib.h>
 #include <string.h>
@@ -27,16 +28,13 @@ int ifmgrnclExit() {
     return ret;
 }
 
+// not cleared, every call sets the fields it uses
 static void *allocIobuf(u32 size) {
-    void *ptr = svcAlloc(0xCAFF, size);
-
-    if (ptr) memset(ptr, 0x00, size);
-
-    return ptr;
+    return slab_alloc(size);
 }
 
 static void freeIobuf(void *ptr) {
-    svcFree(0xCAFF, ptr);
+    slab_free(ptr);
 }
 
 int IFMGRNCL_GetInterfaceStatus(u16 interface_id, u16 *out_status) {
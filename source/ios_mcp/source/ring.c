@@ -0,0 +1,180 @@
+#include "ring.h"
+#include "heap.h"
+#include "imports.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+#define RING_CACHE_LINE 0x20
+#define RING_NOBLOCK    1
+
+static RingHeader *ring;
+static u32 ringEntries;
+static int ringOwner; // -1 without a ring, ring_init sets it as .data is not part of the binary
+static volatile int ringStop;
+static RingHandler ringHandler;
+static mutex_t ringMutex;
+
+static u32 doorbellQueue[1];
+static int doorbellQueueId;
+
+static void ring_invalidate(u32 address, u32 size) {
+    if (size) {
+        u32 start = address & ~(RING_CACHE_LINE - 1);
+        svcInvalidateDCache((void *) start, ((address + size + RING_CACHE_LINE - 1) & ~(RING_CACHE_LINE - 1)) - start);
+    }
+}
+
+static void ring_flush(u32 address, u32 size) {
+    if (size) {
+        u32 start = address & ~(RING_CACHE_LINE - 1);
+        svcFlushDCache((void *) start, ((address + size + RING_CACHE_LINE - 1) & ~(RING_CACHE_LINE - 1)) - start);
+    }
+}
+
+static void ring_set_state(u32 state) {
+    ring->state = state;
+    ring_flush((u32) &ring->sq_head, RING_CACHE_LINE);
+}
+
+static int ring_run(const RingSubmission *s) {
+    // the output buffer is invalidated as well, a write to a stale line would be flushed over newer PPC data
+    ring_invalidate(s->buffer_in, s->length_in);
+    ring_invalidate(s->buffer_io, s->length_io);
+
+    ipcmessage message;
+    memset(&message, 0, sizeof(message));
+    message.command         = IOS_IOCTL;
+    message.fd              = ringOwner;
+    message.ioctl.command   = s->command;
+    message.ioctl.buffer_in = (u32 *) s->buffer_in;
+    message.ioctl.length_in = s->length_in;
+    message.ioctl.buffer_io = (u32 *) s->buffer_io;
+    message.ioctl.length_io = s->length_io;
+    int res                 = ringHandler(&message);
+
+    ring_flush(s->buffer_io, s->length_io);
+    return res;
+}
+
+static void ring_drain(void) {
+    RingSubmission *submissions = (RingSubmission *) (ring + 1);
+    RingCompletion *completions = (RingCompletion *) (submissions + ringEntries);
+
+    ring_set_state(RING_STATE_BUSY);
+    while (!ringStop) {
+        ring_invalidate((u32) ring, RING_CACHE_LINE);
+        if (ring->sq_head == ring->sq_tail) {
+            // a submission that came in before PPC saw the idle state is found by the check after it
+            if (ring->state == RING_STATE_IDLE) {
+                break;
+            }
+            ring_set_state(RING_STATE_IDLE);
+            continue;
+        }
+        if (ring->state != RING_STATE_BUSY) {
+            ring_set_state(RING_STATE_BUSY);
+        }
+        if (ring->cq_tail - ring->cq_head >= ringEntries) {
+            // PPC reads completions without a doorbell, so this has to poll
+            usleep(1000);
+            continue;
+        }
+
+        RingSubmission submission;
+        RingSubmission *s = &submissions[ring->sq_head & (ringEntries - 1)];
+        ring_invalidate((u32) s, sizeof(RingSubmission));
+        memcpy(&submission, s, sizeof(RingSubmission));
+
+        int res           = ring_run(&submission);
+        RingCompletion *c = &completions[ring->cq_tail & (ringEntries - 1)];
+        // a line left in the cache from an earlier lap must not be flushed over the completion
+        ring_invalidate((u32) c, sizeof(RingCompletion));
+        c->user_data = submission.user_data;
+        c->result    = res;
+        ring_flush((u32) c, sizeof(RingCompletion));
+
+        ring->sq_head++;
+        ring->cq_tail++;
+        ring_flush((u32) &ring->sq_head, RING_CACHE_LINE);
+    }
+}
+
+static int ring_thread(void *arg) {
+    while (1) {
+        ipcmessage *dummy;
+        svcReceiveMessage(doorbellQueueId, &dummy, 0);
+
+        mutex_lock(&ringMutex);
+        if (ring) {
+            ring_drain();
+        }
+        mutex_unlock(&ringMutex);
+    }
+    return 0;
+}
+
+void ring_init(RingHandler handler) {
+    mutex_init(&ringMutex);
+    ringHandler     = handler;
+    ringOwner       = -1;
+    doorbellQueueId = -1;
+
+    int queueId = svcCreateMessageQueue(doorbellQueue, 1);
+    u8 *stack   = (u8 *) heap_alloc_align(RING_THREAD_STACK_SIZE, 0x20);
+    if (queueId < 0 || !stack) {
+        return;
+    }
+    int threadId = svcCreateThread(ring_thread, 0, (u32 *) (stack + RING_THREAD_STACK_SIZE), RING_THREAD_STACK_SIZE, 0x78, 1);
+    if (threadId < 0) {
+        heap_free(stack);
+        return;
+    }
+    doorbellQueueId = queueId;
+    svcStartThread(threadId);
+}
+
+int ring_setup(int fd, void *address, u32 entries) {
+    if (doorbellQueueId < 0) {
+        return IOS_ERROR_UNKNOWN;
+    }
+    if (address && (((u32) address & (RING_ALIGN - 1)) || entries < 2 || entries > RING_MAX_ENTRIES || (entries & (entries - 1)))) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+    u32 size = sizeof(RingHeader) + (sizeof(RingSubmission) + sizeof(RingCompletion)) * entries;
+    if (address && (u32) address + size < (u32) address) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+    if (ring && ringOwner != fd) {
+        return IOS_ERROR_UNKNOWN;
+    }
+
+    // a drain that waits for PPC to read completions has to give up the lock
+    ringStop = 1;
+    mutex_lock(&ringMutex);
+    ring        = (RingHeader *) address;
+    ringEntries = entries;
+    ringOwner   = address ? fd : -1;
+    if (ring) {
+        // lines of an earlier ring at the same address may still be cached
+        ring_invalidate((u32) ring, size);
+        ring->sq_head = 0;
+        ring->cq_tail = 0;
+        ring_set_state(RING_STATE_IDLE);
+    }
+    ringStop = 0;
+    mutex_unlock(&ringMutex);
+    return 0;
+}
+
+void ring_doorbell(void) {
+    if (doorbellQueueId >= 0) {
+        svcSendMessage(doorbellQueueId, 0, RING_NOBLOCK);
+    }
+}
+
+void ring_close(int fd) {
+    if (ring && ringOwner == fd) {
+        ring_setup(fd, NULL, 0);
+    }
+}
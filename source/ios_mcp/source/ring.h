@@ -0,0 +1,81 @@
+#ifndef RING_H
+#define RING_H
+
+#include "ipc_types.h"
+#include "types.h"
+
+// A submission and a completion ring in PPC memory, set up with IOCTL_RING_SETUP:
+//
+//   [RingHeader][RingSubmission x entries][RingCompletion x entries]
+//
+// The memory is zeroed by PPC before the setup and has to be RING_ALIGN aligned. PPC fills
+// submissions, flushes them, advances sq_tail and flushes the header. Then it invalidates and
+// reads state: while it is RING_STATE_BUSY the ring thread picks the submission up by itself,
+// otherwise IOCTL_RING_DOORBELL wakes it. The thread invalidates what it reads and flushes what
+// it writes, PPC has to invalidate completions and output buffers before reading them.
+//
+// Each submission is a /dev/iosuhax ioctl with the same buffers and result, run as the client
+// that set up the ring. Buffers are physical addresses and have to be RING_ALIGN aligned, other
+// data in the same cache lines would be overwritten. Every header half, submission and completion
+// has a cache line of its own, so neither side ever flushes a line the other one writes.
+//
+// Nothing is mapped for the ring. IOS hands the buffers of regular ioctls to ios_mcp as physical
+// addresses as well and ios_mcp uses them in place, the memory PPC allocates them from is
+// reachable at its physical address. The ring and its buffers have to come from that same memory,
+// e.g. the MEM2 heap PPC takes its ioctl buffers from. Unlike for a regular ioctl, IOS does not
+// check the addresses of ring buffers, they are used with the rights of ios_mcp.
+
+#define RING_ALIGN          0x40
+#define RING_MAX_ENTRIES    0x100
+
+#define RING_THREAD_STACK_SIZE 0x1000
+#ifdef MOCHA_RING
+#define RING_HEAP_SIZE HEAP_BLOCK_SIZE(RING_THREAD_STACK_SIZE, 0x20)
+#else
+#define RING_HEAP_SIZE 0
+#endif
+
+#define RING_STATE_IDLE     0 // the thread waits for the doorbell
+#define RING_STATE_BUSY     1 // the thread works on the ring and reads sq_tail again before it stops
+
+typedef struct RingHeader {
+    // written by PPC
+    u32 sq_tail; // submissions up to here are ready
+    u32 cq_head; // completions up to here were read
+    u32 ppc_pad[6];
+    // written by ios_mcp, on another cache line
+    u32 sq_head; // submissions up to here were taken
+    u32 cq_tail; // completions up to here are ready
+    u32 state;
+    u32 mcp_pad[5];
+} RingHeader;
+
+typedef struct RingSubmission {
+    u32 command; // ioctl command
+    u32 user_data;
+    u32 buffer_in;
+    u32 length_in;
+    u32 buffer_io;
+    u32 length_io;
+    u32 pad[2];
+} RingSubmission;
+
+typedef struct RingCompletion {
+    u32 user_data;
+    s32 result; // result of the ioctl, its output is in buffer_io
+    u32 pad[6];
+} RingCompletion;
+
+typedef int (*RingHandler)(ipcmessage *message);
+
+void ring_init(RingHandler handler);
+
+// Starts working on the ring at address, a NULL address stops it. Only one client can have a ring.
+int ring_setup(int fd, void *address, u32 entries);
+
+void ring_doorbell(void);
+
+// Stops the ring when fd is the client it belongs to.
+void ring_close(int fd);
+
+#endif
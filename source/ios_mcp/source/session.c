@@ -0,0 +1,230 @@
+#include "session.h"
+#include "filecache.h"
+#include "heap.h"
+#include "statcache.h"
+#include "fsa.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+typedef struct {
+    int fd;
+    int handle;
+    u32 type; // SESSION_HANDLE_*, 0 = unused
+} SessionHandle;
+
+typedef struct {
+    int inUse;
+    int fsaFd;
+    u32 fsaRefs;               // IOCTL_FSA_OPENs of fsaFd that were not closed yet
+    u32 requests;              // ioctls and ioctlvs that were not replied to yet
+    ipcmessage *closeMessage;  // IOS_CLOSE that waits for them
+    SessionHandle handles[SESSION_MAX_HANDLES];
+} Session;
+static_assert(sizeof(Session) <= SESSION_SIZE, "SESSION_SIZE is too small");
+
+// on the heap, the .bss of ios_mcp is too small for it
+static Session *sessions;
+static mutex_t sessionMutex;
+
+void session_init(void) {
+    mutex_init(&sessionMutex);
+
+    sessions = (Session *) heap_alloc(sizeof(Session) * SESSION_MAX);
+    if (sessions) {
+        memset(sessions, 0, sizeof(Session) * SESSION_MAX);
+    }
+}
+
+u32 session_open(void) {
+    u32 id = SESSION_MAX;
+
+    mutex_lock(&sessionMutex);
+    for (u32 i = 0; sessions && i < SESSION_MAX; i++) {
+        if (!sessions[i].inUse) {
+            memset(&sessions[i], 0, sizeof(Session));
+            sessions[i].inUse = 1;
+            sessions[i].fsaFd = -1;
+            id                = i;
+            break;
+        }
+    }
+    mutex_unlock(&sessionMutex);
+
+    return id;
+}
+
+// Closes a handle the client left open, file data still buffered for it is written first.
+static void session_release_handle(SessionHandle *h) {
+    switch (h->type) {
+        case SESSION_HANDLE_FILE:
+            filecache_sync(h->fd, h->handle, FILECACHE_SYNC_CLOSE);
+            FSA_CloseFile(h->fd, h->handle);
+            statcache_file_changed(h->fd, h->handle, 1);
+            break;
+        case SESSION_HANDLE_DIR:
+            FSA_CloseDir(h->fd, h->handle);
+            break;
+        case SESSION_HANDLE_RAW:
+            FSA_RawClose(h->fd, h->handle);
+            break;
+    }
+    h->type = 0;
+}
+
+// Releases the handles the client left open on fd, or on any fd for -1. The FSA calls are made
+// without sessionMutex, so the requests of other sessions don't wait for them.
+static void session_release_handles(Session *s, int fd) {
+    for (u32 i = 0; i < SESSION_MAX_HANDLES; i++) {
+        mutex_lock(&sessionMutex);
+        SessionHandle h = s->handles[i];
+        int release     = h.type && (fd < 0 || h.fd == fd);
+        if (release) {
+            s->handles[i].type = 0;
+        }
+        mutex_unlock(&sessionMutex);
+
+        if (release) {
+            session_release_handle(&h);
+        }
+    }
+}
+
+// Runs once no request of the session is left, IOS sends no new ones after the IOS_CLOSE.
+static void session_finish_close(Session *s) {
+    ipcmessage *message = s->closeMessage;
+
+    session_release_handles(s, -1);
+    if (s->fsaFd >= 0) {
+        svcClose(s->fsaFd);
+    }
+
+    // only now the session can be handed out again
+    mutex_lock(&sessionMutex);
+    s->closeMessage = NULL;
+    s->inUse        = 0;
+    mutex_unlock(&sessionMutex);
+
+    svcResourceReply(message, 0);
+}
+
+void session_close(u32 id, ipcmessage *message) {
+    if (id >= SESSION_MAX) {
+        svcResourceReply(message, 0);
+        return;
+    }
+
+    mutex_lock(&sessionMutex);
+    Session *s      = &sessions[id];
+    s->closeMessage = message;
+    int idle        = s->requests == 0;
+    mutex_unlock(&sessionMutex);
+
+    // otherwise the last session_end_request finishes it
+    if (idle) {
+        session_finish_close(s);
+    }
+}
+
+void session_begin_request(u32 id) {
+    if (id >= SESSION_MAX) {
+        return;
+    }
+
+    mutex_lock(&sessionMutex);
+    sessions[id].requests++;
+    mutex_unlock(&sessionMutex);
+}
+
+void session_end_request(u32 id) {
+    if (id >= SESSION_MAX) {
+        return;
+    }
+
+    mutex_lock(&sessionMutex);
+    Session *s = &sessions[id];
+    int close  = --s->requests == 0 && s->closeMessage;
+    mutex_unlock(&sessionMutex);
+
+    if (close) {
+        session_finish_close(s);
+    }
+}
+
+int session_fsa_open(u32 id) {
+    if (id >= SESSION_MAX) {
+        return svcOpen("/dev/fsa", 0);
+    }
+
+    mutex_lock(&sessionMutex);
+    Session *s = &sessions[id];
+    if (s->fsaFd < 0) {
+        s->fsaFd   = svcOpen("/dev/fsa", 0);
+        s->fsaRefs = 0;
+    }
+    int fd = s->fsaFd;
+    if (fd >= 0) {
+        s->fsaRefs++;
+    }
+    mutex_unlock(&sessionMutex);
+    return fd;
+}
+
+int session_fsa_close(u32 id, int fd) {
+    if (id >= SESSION_MAX) {
+        return svcClose(fd);
+    }
+
+    mutex_lock(&sessionMutex);
+    Session *s = &sessions[id];
+    if (fd != s->fsaFd) {
+        mutex_unlock(&sessionMutex);
+        return svcClose(fd);
+    }
+    // the last close really closes the handle, so no cwd or other FSA state is left for the next open
+    int last = --s->fsaRefs == 0;
+    if (last) {
+        s->fsaFd = -1;
+    }
+    mutex_unlock(&sessionMutex);
+
+    if (!last) {
+        return 0;
+    }
+    session_release_handles(s, fd);
+    return svcClose(fd);
+}
+
+void session_add_handle(u32 id, int fd, int handle, u32 type) {
+    if (id >= SESSION_MAX) {
+        return;
+    }
+
+    mutex_lock(&sessionMutex);
+    for (u32 i = 0; i < SESSION_MAX_HANDLES; i++) {
+        SessionHandle *h = &sessions[id].handles[i];
+        if (!h->type) {
+            h->fd     = fd;
+            h->handle = handle;
+            h->type   = type;
+            break;
+        }
+    }
+    mutex_unlock(&sessionMutex);
+}
+
+void session_remove_handle(u32 id, int fd, int handle) {
+    if (id >= SESSION_MAX) {
+        return;
+    }
+
+    mutex_lock(&sessionMutex);
+    for (u32 i = 0; i < SESSION_MAX_HANDLES; i++) {
+        SessionHandle *h = &sessions[id].handles[i];
+        if (h->type && h->fd == fd && h->handle == handle) {
+            h->type = 0;
+            break;
+        }
+    }
+    mutex_unlock(&sessionMutex);
+}
@@ -0,0 +1,85 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "ipc_types.h"
+#include "svc.h"
+#include "types.h"
+
+#define SESSION_MAX         16
+#define SESSION_MAX_HANDLES 32
+
+#define SESSION_HANDLE_FILE 1
+#define SESSION_HANDLE_DIR  2
+#define SESSION_HANDLE_RAW  3
+
+#ifdef MOCHA_SESSIONS
+
+// the session table session_init allocates, one session is at most SESSION_SIZE bytes
+#define SESSION_SIZE      (0x18 + SESSION_MAX_HANDLES * 0xC)
+#define SESSION_HEAP_SIZE HEAP_BLOCK_SIZE(SESSION_SIZE * SESSION_MAX, 0x10)
+
+void session_init(void);
+
+// Returns the id that is replied to IOS_OPEN and comes back as message->fd. When all sessions
+// are taken SESSION_MAX is returned, the client then works as before but nothing is tracked.
+u32 session_open(void);
+
+// Closes the handles the client left open and the cached /dev/fsa handle, then replies to the
+// IOS_CLOSE in message. That waits for the requests of the session that are still running.
+void session_close(u32 id, ipcmessage *message);
+
+// Counts an ioctl or ioctlv of the session from when it is received until it is replied to.
+void session_begin_request(u32 id);
+
+void session_end_request(u32 id);
+
+// /dev/fsa handle of the session. Opens of the client share it while it is open, so they also
+// share its working directory: IOCTL_FSA_CHDIR on one of them changes it for all. The handle is
+// closed by the last matching session_fsa_close or when the session is closed.
+int session_fsa_open(u32 id);
+
+int session_fsa_close(u32 id, int fd);
+
+void session_add_handle(u32 id, int fd, int handle, u32 type);
+
+void session_remove_handle(u32 id, int fd, int handle);
+
+#else
+
+#define SESSION_HEAP_SIZE 0
+
+// without sessions nothing is tracked, the handles of a client that goes away stay open
+static inline void session_init(void) {
+}
+
+static inline u32 session_open(void) {
+    return 0;
+}
+
+static inline void session_close(u32 id, ipcmessage *message) {
+    svcResourceReply(message, 0);
+}
+
+static inline void session_begin_request(u32 id) {
+}
+
+static inline void session_end_request(u32 id) {
+}
+
+static inline int session_fsa_open(u32 id) {
+    return svcOpen("/dev/fsa", 0);
+}
+
+static inline int session_fsa_close(u32 id, int fd) {
+    return svcClose(fd);
+}
+
+static inline void session_add_handle(u32 id, int fd, int handle, u32 type) {
+}
+
+static inline void session_remove_handle(u32 id, int fd, int handle) {
+}
+
+#endif
+
+#endif
@@ -0,0 +1,71 @@
+#include "slab.h"
+#include "heap.h"
+#include "svc.h"
+#include <stdlib.h>
+
+#define SLAB_NOBLOCK 1
+
+// The free blocks of a class are kept in a message queue, which makes taking
+// and returning them thread safe without a lock.
+typedef struct {
+    u32 size;
+    u32 count;
+    u8 *blocks;
+    u32 *queue;
+    int queueId;
+} SlabClass;
+
+#define SLAB_CLASSES 2
+
+// filled in by slab_init, an initialised table would be placed in .data, which is not loaded
+static SlabClass classes[SLAB_CLASSES];
+
+void slab_init(void) {
+    classes[0].size  = SLAB_SMALL_SIZE;
+    classes[0].count = SLAB_SMALL_COUNT;
+    classes[1].size  = SLAB_LARGE_SIZE;
+    classes[1].count = SLAB_LARGE_COUNT;
+
+    for (u32 i = 0; i < SLAB_CLASSES; i++) {
+        SlabClass *c = &classes[i];
+        c->blocks    = (u8 *) heap_alloc_align(c->size * c->count, SLAB_ALIGN);
+        c->queue     = (u32 *) heap_alloc(c->count * sizeof(u32));
+        c->queueId   = (c->blocks && c->queue) ? svcCreateMessageQueue(c->queue, c->count) : -1;
+        if (c->queueId < 0) {
+            if (c->blocks) heap_free(c->blocks);
+            if (c->queue) heap_free(c->queue);
+            c->blocks = NULL;
+            continue;
+        }
+
+        for (u32 j = 0; j < c->count; j++) {
+            svcSendMessage(c->queueId, (u32) (c->blocks + j * c->size), SLAB_NOBLOCK);
+        }
+    }
+}
+
+void *slab_alloc(u32 size) {
+    for (u32 i = 0; i < SLAB_CLASSES; i++) {
+        SlabClass *c = &classes[i];
+        if (size > c->size) {
+            continue;
+        }
+        void *ptr;
+        if (c->blocks && svcReceiveMessage(c->queueId, (ipcmessage **) &ptr, SLAB_NOBLOCK) >= 0) {
+            return ptr;
+        }
+        break;
+    }
+    return heap_alloc_align(size, SLAB_ALIGN);
+}
+
+void slab_free(void *ptr) {
+    for (u32 i = 0; i < SLAB_CLASSES; i++) {
+        SlabClass *c = &classes[i];
+        if (c->blocks && (u8 *) ptr >= c->blocks && (u8 *) ptr < c->blocks + c->size * c->count) {
+            svcSendMessage(c->queueId, (u32) ptr, SLAB_NOBLOCK);
+            return;
+        }
+    }
+    heap_free(ptr);
+}
@@ -0,0 +1,51 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "heap.h"
+#include "types.h"
+
+#define SLAB_ALIGN       0x40
+
+// small iobufs of /dev/socket and /dev/net/ifmgr/ncl
+#define SLAB_SMALL_SIZE  0x40
+#define SLAB_SMALL_COUNT 32
+// FSA iobufs and the data of most socket transfers
+#define SLAB_LARGE_SIZE  0x840
+#ifndef SLAB_LARGE_COUNT
+#define SLAB_LARGE_COUNT 32
+#endif
+
+#ifdef MOCHA_SLAB
+
+// what slab_init takes from the private heap
+#define SLAB_HEAP_SIZE                                                                                        \
+    (HEAP_BLOCK_SIZE(SLAB_SMALL_SIZE * SLAB_SMALL_COUNT, SLAB_ALIGN) + HEAP_BLOCK_SIZE(SLAB_SMALL_COUNT * 4, 0x10) + \
+     HEAP_BLOCK_SIZE(SLAB_LARGE_SIZE * SLAB_LARGE_COUNT, SLAB_ALIGN) + HEAP_BLOCK_SIZE(SLAB_LARGE_COUNT * 4, 0x10))
+
+// Allocates the blocks of every size class up front.
+void slab_init(void);
+
+// Returns a SLAB_ALIGN aligned block of at least size bytes, its contents are not cleared.
+// When the matching class is used up or size is bigger than all of them it comes from the heap.
+void *slab_alloc(u32 size);
+
+void slab_free(void *ptr);
+
+#else
+
+#define SLAB_HEAP_SIZE 0
+
+static inline void slab_init(void) {
+}
+
+static inline void *slab_alloc(u32 size) {
+    return heap_alloc_align(size, SLAB_ALIGN);
+}
+
+static inline void slab_free(void *ptr) {
+    heap_free(ptr);
+}
+
+#endif
+
+#endif
@@ -1,5 +1,6 @@
 #include "socket.h"
 #include "imports.h"
+#include "slab.h"
 #include "svc.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,16 +29,13 @@ int socketExit() {
     return ret;
 }
 
+// not cleared, every call sets the fields it uses
 static void *allocIobuf(u32 size) {
-    void *ptr = svcAlloc(0xCAFF, size);
-
-    if (ptr) memset(ptr, 0x00, size);
-
-    return ptr;
+    return slab_alloc(size);
 }
 
 static void freeIobuf(void *ptr) {
-    svcFree(0xCAFF, ptr);
+    slab_free(ptr);
 }
 
 int socket(int domain, int type, int protocol) {
@@ -71,6 +69,8 @@ int accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
     u32 *inbuf  = (u32 *) iobuf;
     u32 *outbuf = (u32 *) inbuf;
 
+    // the address words are passed in as well
+    memset(inbuf, 0, 0x18);
     inbuf[0] = sockfd;
 
     int ret = -1;
@@ -155,8 +155,10 @@ int shutdown(int sockfd, int how) {
 int recv(int sockfd, void *buf, size_t len, int flags) {
     if (!len) return -101;
 
-    // TODO : size checks, split up data into multiple vectors if necessary
-    void *data_buf = svcAllocAlign(0xCAFF, len, 0x40);
+    // larger buffers would come from the heap on every call, a stream socket may return less anyway
+    if (len > SLAB_LARGE_SIZE) len = SLAB_LARGE_SIZE;
+
+    void *data_buf = slab_alloc(len);
     if (!data_buf) return -100;
 
     u8 *iobuf      = allocIobuf(0x38);
@@ -166,6 +168,7 @@ int recv(int sockfd, void *buf, size_t len, int flags) {
     inbuf[0] = sockfd;
     inbuf[1] = flags;
 
+    memset(iovec, 0, 0x30);
     iovec[0].ptr = inbuf;
     iovec[0].len = 0x8;
     iovec[1].ptr = (void *) data_buf;
@@ -182,11 +185,8 @@ int recv(int sockfd, void *buf, size_t len, int flags) {
     return ret;
 }
 
-int send(int sockfd, const void *buf, size_t len, int flags) {
-    if (!buf || !len) return -101;
-
-    // TODO : size checks, split up data into multiple vectors if necessary
-    void *data_buf = svcAllocAlign(0xCAFF, len, 0x40);
+static int send_block(int sockfd, const void *buf, size_t len, int flags) {
+    void *data_buf = slab_alloc(len);
     if (!data_buf) return -100;
 
     u8 *iobuf      = allocIobuf(0x38);
@@ -198,6 +198,7 @@ int send(int sockfd, const void *buf, size_t len, int flags) {
     inbuf[0] = sockfd;
     inbuf[1] = flags;
 
+    memset(iovec, 0, 0x30);
     iovec[0].ptr = inbuf;
     iovec[0].len = 0x8;
     iovec[1].ptr = (void *) data_buf;
@@ -209,3 +210,21 @@ int send(int sockfd, const void *buf, size_t len, int flags) {
     freeIobuf(iobuf);
     return ret;
 }
+
+int send(int sockfd, const void *buf, size_t len, int flags) {
+    if (!buf || !len) return -101;
+
+    // sent in blocks that fit the slab, larger buffers would come from the heap on every call
+    int sent = 0;
+    while (len) {
+        size_t block = len < SLAB_LARGE_SIZE ? len : SLAB_LARGE_SIZE;
+        int ret      = send_block(sockfd, buf, block, flags);
+        if (ret < 0) return sent ? sent : ret;
+
+        sent += ret;
+        if ((size_t) ret < block) break;
+        buf = (const u8 *) buf + ret;
+        len -= ret;
+    }
+    return sent;
+}
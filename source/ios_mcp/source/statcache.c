@@ -0,0 +1,286 @@
+#include "statcache.h"
+#include "heap.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+typedef struct {
+    u32 hash; // 0 = unused
+    s16 next; // next entry in the bucket, -1 = end of the chain
+    u32 time; // timer_ticks when the stat was fetched
+    int result;
+    FSStat stat;
+    char path[STATCACHE_MAX_PATH];
+} StatCacheEntry;
+static_assert(sizeof(StatCacheEntry) <= STATCACHE_ENTRY_SIZE, "STATCACHE_ENTRY_SIZE is too small");
+
+typedef struct {
+    int fd;
+    int handle;
+    u32 hash; // 0 = opened with a relative path
+    int inUse;
+} StatCacheHandle;
+static_assert(sizeof(StatCacheHandle) <= 0x10, "STATCACHE_HEAP_SIZE is too small");
+
+// on the heap, the .bss of ios_mcp is too small for them
+static StatCacheEntry *entries;
+static StatCacheHandle *handles;
+static s16 buckets[STATCACHE_BUCKETS];
+static u32 nextVictim;
+static u32 generation; // bumped on every invalidation, stats fetched before one are not added
+static StatCacheStats stats;
+static mutex_t statMutex;
+
+static u32 statcache_hash(const char *path) {
+    u32 hash = 0x811C9DC5;
+    while (*path) {
+        hash ^= (u8) *path++;
+        hash *= 0x01000193;
+    }
+    return hash ? hash : 1;
+}
+
+static int statcache_lookup(u32 hash, const char *path) {
+    for (int i = buckets[hash % STATCACHE_BUCKETS]; i >= 0; i = entries[i].next) {
+        if (entries[i].hash == hash && strncmp(entries[i].path, path, STATCACHE_MAX_PATH) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void statcache_remove(int index) {
+    StatCacheEntry *e = &entries[index];
+    s16 *link         = &buckets[e->hash % STATCACHE_BUCKETS];
+    while (*link != index) {
+        link = &entries[*link].next;
+    }
+    *link   = e->next;
+    e->hash = 0;
+}
+
+// Entries are replaced in the order they were added, they expire after the TTL anyway.
+static void statcache_insert(u32 hash, const char *path, u32 length, int result, const FSStat *stat) {
+    int index  = nextVictim;
+    nextVictim = (nextVictim + 1) % STATCACHE_ENTRIES;
+
+    StatCacheEntry *e = &entries[index];
+    if (e->hash) {
+        statcache_remove(index);
+    }
+    e->hash   = hash;
+    e->time   = timer_ticks();
+    e->result = result;
+    memcpy(&e->stat, stat, sizeof(FSStat));
+    memcpy(e->path, path, length + 1);
+
+    e->next                           = buckets[hash % STATCACHE_BUCKETS];
+    buckets[hash % STATCACHE_BUCKETS] = index;
+}
+
+static void statcache_clear(void) {
+    for (u32 i = 0; i < STATCACHE_ENTRIES; i++) {
+        if (entries[i].hash) {
+            entries[i].hash = 0;
+            stats.invalidations++;
+        }
+    }
+    memset(buckets, 0xFF, sizeof(buckets));
+    generation++;
+}
+
+void statcache_init(void) {
+    mutex_init(&statMutex);
+    memset(buckets, 0xFF, sizeof(buckets));
+
+    u8 *mem = (u8 *) heap_alloc(sizeof(StatCacheEntry) * STATCACHE_ENTRIES + sizeof(StatCacheHandle) * STATCACHE_MAX_HANDLES);
+    if (!mem) {
+        return;
+    }
+    memset(mem, 0, sizeof(StatCacheEntry) * STATCACHE_ENTRIES + sizeof(StatCacheHandle) * STATCACHE_MAX_HANDLES);
+    entries       = (StatCacheEntry *) mem;
+    handles       = (StatCacheHandle *) (mem + sizeof(StatCacheEntry) * STATCACHE_ENTRIES);
+    stats.entries = STATCACHE_ENTRIES;
+    stats.ttl     = STATCACHE_TTL;
+}
+
+int statcache_get_stat(int fd, char *path, FSStat *out_data) {
+    u32 length = strlen(path);
+    if (!entries || !stats.ttl || path[0] != '/' || length >= STATCACHE_MAX_PATH) {
+        return FSA_GetStat(fd, path, out_data);
+    }
+
+    u32 hash = statcache_hash(path);
+    mutex_lock(&statMutex);
+    int index = statcache_lookup(hash, path);
+    if (index >= 0 && timer_ticks() - entries[index].time < stats.ttl * (LT_TIMER_TICKS_PER_SEC / 1000)) {
+        int res = entries[index].result;
+        memcpy(out_data, &entries[index].stat, sizeof(FSStat));
+        stats.hits++;
+        mutex_unlock(&statMutex);
+        return res;
+    }
+    if (index >= 0) {
+        statcache_remove(index);
+    }
+    stats.misses++;
+    u32 fetchGeneration = generation;
+    mutex_unlock(&statMutex);
+
+    // not found is cached as well, existence checks mostly fail
+    int res = FSA_GetStat(fd, path, out_data);
+    if (res >= 0 || res == FSA_STATUS_NOT_FOUND) {
+        mutex_lock(&statMutex);
+        if (fetchGeneration == generation && statcache_lookup(hash, path) < 0) {
+            statcache_insert(hash, path, length, res, out_data);
+        }
+        mutex_unlock(&statMutex);
+    }
+    return res;
+}
+
+void statcache_invalidate_path(char *path) {
+    if (!entries) {
+        return;
+    }
+
+    mutex_lock(&statMutex);
+    if (path[0] != '/') {
+        statcache_clear();
+        mutex_unlock(&statMutex);
+        return;
+    }
+
+    u32 length       = strlen(path);
+    u32 parentLength = length;
+    while (parentLength > 1 && path[parentLength - 1] != '/') {
+        parentLength--;
+    }
+    parentLength--;
+
+    for (u32 i = 0; i < STATCACHE_ENTRIES; i++) {
+        StatCacheEntry *e = &entries[i];
+        if (!e->hash) {
+            continue;
+        }
+        int below  = strncmp(e->path, path, length) == 0 && (e->path[length] == '\0' || e->path[length] == '/');
+        int parent = parentLength && strncmp(e->path, path, parentLength) == 0 && e->path[parentLength] == '\0';
+        if (below || parent) {
+            statcache_remove(i);
+            stats.invalidations++;
+        }
+    }
+    generation++;
+    mutex_unlock(&statMutex);
+}
+
+void statcache_invalidate_all(void) {
+    if (!entries) {
+        return;
+    }
+    mutex_lock(&statMutex);
+    statcache_clear();
+    mutex_unlock(&statMutex);
+}
+
+static StatCacheHandle *statcache_find_handle(int fd, int fileHandle) {
+    for (u32 i = 0; i < STATCACHE_MAX_HANDLES; i++) {
+        if (handles[i].inUse && handles[i].fd == fd && handles[i].handle == fileHandle) {
+            return &handles[i];
+        }
+    }
+    return NULL;
+}
+
+u32 statcache_path_hash(const char *path) {
+    return (path[0] == '/' && strlen(path) < STATCACHE_MAX_PATH) ? statcache_hash(path) : 0;
+}
+
+u32 statcache_file_hash(int fd, int fileHandle) {
+    u32 hash = 0;
+    if (!entries) {
+        return hash;
+    }
+    mutex_lock(&statMutex);
+    StatCacheHandle *h = statcache_find_handle(fd, fileHandle);
+    if (h) {
+        hash = h->hash;
+    }
+    mutex_unlock(&statMutex);
+    return hash;
+}
+
+int statcache_mode_writes(const char *mode) {
+    for (const char *m = mode; *m; m++) {
+        if (*m == 'w' || *m == 'a' || *m == '+') {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void statcache_open_file(int fd, int fileHandle, char *path, char *mode) {
+    if (!entries) {
+        return;
+    }
+    if (statcache_mode_writes(mode)) {
+        statcache_invalidate_path(path);
+    }
+
+    mutex_lock(&statMutex);
+    for (u32 i = 0; i < STATCACHE_MAX_HANDLES; i++) {
+        if (!handles[i].inUse) {
+            handles[i].inUse  = 1;
+            handles[i].fd     = fd;
+            handles[i].handle = fileHandle;
+            handles[i].hash   = statcache_path_hash(path);
+            break;
+        }
+    }
+    mutex_unlock(&statMutex);
+}
+
+void statcache_file_changed(int fd, int fileHandle, int closed) {
+    if (!entries) {
+        return;
+    }
+
+    // the path of handles that were not recorded is unknown, everything has to go
+    mutex_lock(&statMutex);
+    StatCacheHandle *h = statcache_find_handle(fd, fileHandle);
+    if (!h || !h->hash) {
+        statcache_clear();
+    } else {
+        for (int i = buckets[h->hash % STATCACHE_BUCKETS]; i >= 0;) {
+            int next = entries[i].next;
+            if (entries[i].hash == h->hash) {
+                statcache_remove(i);
+                stats.invalidations++;
+            }
+            i = next;
+        }
+        generation++;
+    }
+    if (h && closed) {
+        h->inUse = 0;
+    }
+    mutex_unlock(&statMutex);
+}
+
+void statcache_set_ttl(u32 ttl) {
+    if (!entries) {
+        return;
+    }
+    mutex_lock(&statMutex);
+    stats.ttl = ttl;
+    if (!ttl) {
+        statcache_clear();
+    }
+    mutex_unlock(&statMutex);
+}
+
+void statcache_get_stats(StatCacheStats *out) {
+    mutex_lock(&statMutex);
+    memcpy(out, &stats, sizeof(StatCacheStats));
+    mutex_unlock(&statMutex);
+}
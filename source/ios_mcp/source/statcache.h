@@ -0,0 +1,86 @@
+#ifndef STATCACHE_H
+#define STATCACHE_H
+
+#include "fsa.h"
+#include "types.h"
+
+#ifndef STATCACHE_ENTRIES
+#define STATCACHE_ENTRIES 64
+#endif
+#define STATCACHE_BUCKETS     32
+#define STATCACHE_MAX_PATH    0x100 // longer paths are not cached
+#define STATCACHE_MAX_HANDLES 32
+#ifndef STATCACHE_TTL
+#define STATCACHE_TTL 2000 // ms, changes made by other processes show up after at most this long
+#endif
+
+typedef struct StatCacheStats {
+    u32 entries;
+    u32 ttl;    // ms, 0 = disabled
+    u32 hits;
+    u32 misses;
+    u32 invalidations; // entries dropped because of a change
+} StatCacheStats;
+
+#ifdef MOCHA_FSA_CACHE
+
+// the entries and handles statcache_init allocates, an entry is at most STATCACHE_ENTRY_SIZE bytes
+#define STATCACHE_ENTRY_SIZE 0x180
+#define STATCACHE_HEAP_SIZE  HEAP_BLOCK_SIZE(STATCACHE_ENTRY_SIZE * STATCACHE_ENTRIES + 0x10 * STATCACHE_MAX_HANDLES, 0x10)
+
+void statcache_init(void);
+
+// Replaces FSA_GetStat. Only absolute paths are cached, relative ones depend on the working directory of fd.
+int statcache_get_stat(int fd, char *path, FSStat *out_data);
+
+// Drops path, everything below it and its parent directory, a relative path drops everything.
+void statcache_invalidate_path(char *path);
+
+void statcache_invalidate_all(void);
+
+// Remembers the path of an opened file for statcache_file_changed, a mode that writes drops the path.
+void statcache_open_file(int fd, int fileHandle, char *path, char *mode);
+
+// Drops the path of a file handle after a write, truncate or close.
+void statcache_file_changed(int fd, int fileHandle, int closed);
+
+// Hash of an absolute path, 0 if the path is relative or too long to be cached.
+u32 statcache_path_hash(const char *path);
+
+// Hash of the path a file was opened with, 0 if it is unknown.
+u32 statcache_file_hash(int fd, int fileHandle);
+
+// Whether an FSA open mode allows writing to the file.
+int statcache_mode_writes(const char *mode);
+
+// Sets the time entries are kept, 0 disables and clears the cache.
+void statcache_set_ttl(u32 ttl);
+
+void statcache_get_stats(StatCacheStats *stats);
+
+#else
+
+#define STATCACHE_HEAP_SIZE 0
+
+static inline void statcache_init(void) {
+}
+
+static inline int statcache_get_stat(int fd, char *path, FSStat *out_data) {
+    return FSA_GetStat(fd, path, out_data);
+}
+
+static inline void statcache_invalidate_path(char *path) {
+}
+
+static inline void statcache_invalidate_all(void) {
+}
+
+static inline void statcache_open_file(int fd, int fileHandle, char *path, char *mode) {
+}
+
+static inline void statcache_file_changed(int fd, int fileHandle, int closed) {
+}
+
+#endif
+
+#endif
@@ -3,11 +3,7 @@
 
 #include "ipc_types.h"
 
-typedef struct {
-    void *ptr;
-    u32 len;
-    u32 unk;
-} iovec_s;
+int svcCreateHeap(void *ptr, u32 size);
 
 void *svcAlloc(u32 heapid, u32 size);
 
@@ -27,6 +23,8 @@ int svcIoctl(int fd, u32 request, void *input_buffer, u32 input_buffer_len, void
 
 int svcIoctlv(int fd, u32 request, u32 vector_count_in, u32 vector_count_out, iovec_s *vector);
 
+int svcIoctlvAsync(int fd, u32 request, u32 vector_count_in, u32 vector_count_out, iovec_s *vector, int queueid, ipcmessage *reply);
+
 int svcInvalidateDCache(void *address, u32 size);
 
 int svcFlushDCache(void *address, u32 size);
@@ -39,6 +37,8 @@ int svcCreateMessageQueue(u32 *ptr, u32 n_msgs);
 
 int svcDestroyMessageQueue(int queueid);
 
+int svcSendMessage(int queueid, u32 message, u32 flags);
+
 int svcRegisterResourceManager(const char *device, int queueid);
 
 int svcReceiveMessage(int queueid, ipcmessage **ipc_buf, u32 flags);
@@ -26,12 +26,24 @@ svcDestroyMessageQueue:
 	.word 0xE7F00DF0
 	bx lr
 
+.global svcSendMessage
+.type svcSendMessage, %function
+svcSendMessage:
+	.word 0xE7F00EF0
+	bx lr
+
 .global svcReceiveMessage
 .type svcReceiveMessage, %function
 svcReceiveMessage:
 	.word 0xE7F010F0
 	bx lr
 
+.global svcCreateHeap
+.type svcCreateHeap, %function
+svcCreateHeap:
+	.word 0xE7F024F0
+	bx lr
+
 .global svcAlloc
 .type svcAlloc, %function
 svcAlloc:
@@ -92,6 +104,12 @@ svcIoctlv:
 	.word 0xE7F039F0
 	bx lr
 
+.global svcIoctlvAsync
+.type svcIoctlvAsync, %function
+svcIoctlvAsync:
+	.word 0xE7F040F0
+	bx lr
+
 .global svcResourceReply
 .type svcResourceReply, %function
 svcResourceReply:
@@ -0,0 +1,19 @@
+#include "utils.h"
+#include "svc.h"
+
+int mutex_init(mutex_t *mutex) {
+    mutex->queueId = svcCreateMessageQueue(mutex->token, 1);
+    if (mutex->queueId < 0) {
+        return mutex->queueId;
+    }
+    return svcSendMessage(mutex->queueId, 0, 0);
+}
+
+void mutex_lock(mutex_t *mutex) {
+    ipcmessage *token;
+    svcReceiveMessage(mutex->queueId, &token, 0);
+}
+
+void mutex_unlock(mutex_t *mutex) {
+    svcSendMessage(mutex->queueId, 0, 0);
+}
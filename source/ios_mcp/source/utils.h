@@ -0,0 +1,32 @@
+#ifndef UTILS_H
+#define UTILS_H
+
+#include "types.h"
+
+// Starbuck timer, counts at 1/128 of the 243 MHz IOP clock
+#define LT_TIMER               (*(vu32 *) 0x0D800010)
+#define LT_TIMER_TICKS_PER_SEC 1898437
+
+static inline u32 timer_ticks(void) {
+    return LT_TIMER;
+}
+
+// 17261 / 2^15 ~= 1000000 / LT_TIMER_TICKS_PER_SEC
+static inline u32 ticks_to_us(u32 ticks) {
+    return (u32) (((u64) ticks * 17261) >> 15);
+}
+
+// IOS has no mutexes for user processes, a message queue holding a single
+// token is used instead: receiving the token locks, sending it back unlocks
+typedef struct {
+    int queueId;
+    u32 token[1];
+} mutex_t;
+
+int mutex_init(mutex_t *mutex);
+
+void mutex_lock(mutex_t *mutex);
+
+void mutex_unlock(mutex_t *mutex);
+
+#endif
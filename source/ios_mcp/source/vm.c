@@ -0,0 +1,148 @@
+#include "vm.h"
+#include "fsa.h"
+#include "imports.h"
+#include "ipc_types.h"
+#include <string.h>
+
+typedef int (*vm_call_t)(u32, u32, u32, u32, u32, u32, u32, u32);
+
+static const void *const fsaFunctions[] = {
+        [VM_FSA_OPENFILE]         = FSA_OpenFile,
+        [VM_FSA_OPENFILEEX]       = FSA_OpenFileEx,
+        [VM_FSA_READFILE]         = FSA_ReadFile,
+        [VM_FSA_WRITEFILE]        = FSA_WriteFile,
+        [VM_FSA_READFILEWITHPOS]  = FSA_ReadFileWithPos,
+        [VM_FSA_WRITEFILEWITHPOS] = FSA_WriteFileWithPos,
+        [VM_FSA_CLOSEFILE]        = FSA_CloseFile,
+        [VM_FSA_GETSTATFILE]      = FSA_GetStatFile,
+        [VM_FSA_SETPOSFILE]       = FSA_SetPosFile,
+        [VM_FSA_GETSTAT]          = FSA_GetStat,
+        [VM_FSA_OPENDIR]          = FSA_OpenDir,
+        [VM_FSA_READDIR]          = FSA_ReadDir,
+        [VM_FSA_CLOSEDIR]         = FSA_CloseDir,
+        [VM_FSA_MAKEDIR]          = FSA_MakeDir,
+        [VM_FSA_REMOVE]           = FSA_Remove,
+        [VM_FSA_RENAME]           = FSA_Rename,
+        [VM_FSA_CHANGEMODE]       = FSA_ChangeMode,
+        [VM_FSA_MOUNT]            = FSA_Mount,
+        [VM_FSA_UNMOUNT]          = FSA_Unmount,
+        [VM_FSA_FLUSHVOLUME]      = FSA_FlushVolume,
+};
+
+#define R(x) regs[(x) & (VM_REGISTERS - 1)]
+
+int vm_run(u32 *script, u32 script_size, u32 max_steps, u8 *out, u32 out_size, u32 *out_length, u32 *result) {
+    u32 regs[VM_REGISTERS];
+    u32 instructions = script_size / 8;
+    u32 pc           = 0;
+
+    memset(regs, 0, sizeof(regs));
+    *out_length = 0;
+    *result     = 0;
+    if (max_steps == 0 || max_steps > VM_MAX_STEPS) {
+        max_steps = VM_MAX_STEPS;
+    }
+
+    for (u32 step = 0; step < max_steps; step++) {
+        if (pc >= instructions) {
+            return IOS_ERROR_INVALID_ARG;
+        }
+
+        u32 instr = script[pc * 2];
+        u32 imm   = script[pc * 2 + 1];
+        u32 op    = instr >> 24;
+        u32 a     = (instr >> 16) & 0xFF;
+        u32 b     = (instr >> 8) & 0xFF;
+        u32 c     = instr & 0xFF;
+        u32 src   = (c == VM_SRC_IMM) ? imm : R(c);
+        pc++;
+
+        switch (op) {
+            case VM_OP_END:
+                *result = R(a);
+                return 0;
+            case VM_OP_LI:
+                R(a) = imm;
+                break;
+            case VM_OP_LEA:
+                R(a) = (u32) script + imm;
+                break;
+            case VM_OP_MOV:
+                R(a) = src;
+                break;
+            case VM_OP_ADD:
+                R(a) = R(b) + src;
+                break;
+            case VM_OP_SUB:
+                R(a) = R(b) - src;
+                break;
+            case VM_OP_AND:
+                R(a) = R(b) & src;
+                break;
+            case VM_OP_OR:
+                R(a) = R(b) | src;
+                break;
+            case VM_OP_XOR:
+                R(a) = R(b) ^ src;
+                break;
+            case VM_OP_SHL:
+                R(a) = R(b) << (src & 31);
+                break;
+            case VM_OP_SHR:
+                R(a) = R(b) >> (src & 31);
+                break;
+            case VM_OP_MUL:
+                R(a) = R(b) * src;
+                break;
+            case VM_OP_LOAD32:
+                R(a) = *(vu32 *) (R(b) + imm);
+                break;
+            case VM_OP_LOAD8:
+                R(a) = *(vu8 *) (R(b) + imm);
+                break;
+            case VM_OP_STORE32:
+                *(vu32 *) (R(b) + imm) = R(a);
+                break;
+            case VM_OP_STORE8:
+                *(vu8 *) (R(b) + imm) = R(a);
+                break;
+            case VM_OP_MEMCPY:
+                memcpy((void *) R(a), (void *) R(b), R(c));
+                break;
+            case VM_OP_SVC:
+                R(a) = ((vm_call_t) (MCP_SVC_BASE + (imm & 0xFF) * 8))(R(b), R(b + 1), R(b + 2), R(b + 3), R(b + 4), R(b + 5), R(b + 6), R(b + 7));
+                break;
+            case VM_OP_FSA:
+                if (imm >= sizeof(fsaFunctions) / sizeof(fsaFunctions[0])) {
+                    return IOS_ERROR_INVALID_ARG;
+                }
+                R(a) = ((vm_call_t) fsaFunctions[imm])(R(b), R(b + 1), R(b + 2), R(b + 3), R(b + 4), R(b + 5), R(b + 6), R(b + 7));
+                break;
+            case VM_OP_OUT:
+                if (R(c) > out_size - *out_length) {
+                    return IOS_ERROR_INVALID_SIZE;
+                }
+                memcpy(out + *out_length, (void *) R(b), R(c));
+                *out_length += R(c);
+                break;
+            case VM_OP_JMP:
+                pc = imm;
+                break;
+            case VM_OP_BEQ:
+                if (R(a) == R(b)) pc = imm;
+                break;
+            case VM_OP_BNE:
+                if (R(a) != R(b)) pc = imm;
+                break;
+            case VM_OP_BLT:
+                if ((s32) R(a) < (s32) R(b)) pc = imm;
+                break;
+            case VM_OP_BLTU:
+                if (R(a) < R(b)) pc = imm;
+                break;
+            default:
+                return IOS_ERROR_INVALID_ARG;
+        }
+    }
+    return IOS_ERROR_UNKNOWN;
+}
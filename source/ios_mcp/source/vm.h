@@ -0,0 +1,64 @@
+#ifndef VM_H
+#define VM_H
+
+#include "types.h"
+
+// Every instruction is two words: [op << 24 | a << 16 | b << 8 | c][imm].
+// a, b and c are register numbers (modulo VM_REGISTERS), VM_SRC_IMM as c uses imm instead of r[c].
+#define VM_REGISTERS     16
+#define VM_SRC_IMM       0xFF
+#define VM_MAX_STEPS     0x100000
+
+#define VM_OP_END        0x00 // stop, the result is r[a]
+#define VM_OP_LI         0x01 // r[a] = imm
+#define VM_OP_LEA        0x02 // r[a] = address of byte imm of the script, for data stored behind the code
+#define VM_OP_MOV        0x03 // r[a] = src
+#define VM_OP_ADD        0x10 // r[a] = r[b] + src
+#define VM_OP_SUB        0x11
+#define VM_OP_AND        0x12
+#define VM_OP_OR         0x13
+#define VM_OP_XOR        0x14
+#define VM_OP_SHL        0x15
+#define VM_OP_SHR        0x16
+#define VM_OP_MUL        0x17
+#define VM_OP_LOAD32     0x20 // r[a] = *(u32 *) (r[b] + imm)
+#define VM_OP_LOAD8      0x21
+#define VM_OP_STORE32    0x22 // *(u32 *) (r[b] + imm) = r[a]
+#define VM_OP_STORE8     0x23
+#define VM_OP_MEMCPY     0x24 // memcpy(r[a], r[b], r[c])
+#define VM_OP_SVC        0x30 // r[a] = svc imm with the 8 arguments r[b]...
+#define VM_OP_FSA        0x31 // r[a] = FSA function imm (VM_FSA_*) with the arguments r[b]...
+#define VM_OP_OUT        0x32 // appends r[c] bytes at r[b] to the output
+#define VM_OP_JMP        0x40 // continue at instruction imm
+#define VM_OP_BEQ        0x41 // continue at instruction imm if r[a] == r[b]
+#define VM_OP_BNE        0x42
+#define VM_OP_BLT        0x43 // signed
+#define VM_OP_BLTU       0x44 // unsigned
+
+#define VM_FSA_OPENFILE         0
+#define VM_FSA_OPENFILEEX       1
+#define VM_FSA_READFILE         2
+#define VM_FSA_WRITEFILE        3
+#define VM_FSA_READFILEWITHPOS  4
+#define VM_FSA_WRITEFILEWITHPOS 5
+#define VM_FSA_CLOSEFILE        6
+#define VM_FSA_GETSTATFILE      7
+#define VM_FSA_SETPOSFILE       8
+#define VM_FSA_GETSTAT          9
+#define VM_FSA_OPENDIR          10
+#define VM_FSA_READDIR          11
+#define VM_FSA_CLOSEDIR         12
+#define VM_FSA_MAKEDIR          13
+#define VM_FSA_REMOVE           14
+#define VM_FSA_RENAME           15
+#define VM_FSA_CHANGEMODE       16
+#define VM_FSA_MOUNT            17
+#define VM_FSA_UNMOUNT          18
+#define VM_FSA_FLUSHVOLUME      19
+
+// Runs the script for at most max_steps instructions (0 = VM_MAX_STEPS).
+// Returns 0, IOS_ERROR_INVALID_ARG for a bad instruction or jump target, IOS_ERROR_INVALID_SIZE
+// when the output does not fit or IOS_ERROR_UNKNOWN when the step limit is reached.
+int vm_run(u32 *script, u32 script_size, u32 max_steps, u8 *out, u32 out_size, u32 *out_length, u32 *result);
+
+#endif
@@ -0,0 +1,250 @@
+#include "watch.h"
+#include "heap.h"
+#include "imports.h"
+#include "ipc_types.h"
+#include "socket.h"
+#include "svc.h"
+#include "utils.h"
+#include <string.h>
+
+#define WATCH_CACHE_LINE 0x20
+
+typedef struct {
+    WatchParams params;
+    u32 last;
+    u32 polls;
+    int active;
+} WatchEntry;
+
+static WatchEntry entries[WATCH_MAX_ENTRIES];
+static u32 activeEntries;
+static u32 fastEntries;
+static u32 lastSlowPoll; // ticks
+static int subscribers[WATCH_MAX_SUBSCRIBERS];
+static u32 interval;
+static mutex_t watchMutex;
+
+// events kept for watch_poll, the oldest ones are overwritten when nobody polls
+static WatchEvent eventQueue[WATCH_EVENT_QUEUE_SIZE];
+static u32 eventHead;
+static u32 eventCount;
+
+// the watch thread sleeps on this queue while there is nothing to watch
+static u32 wakeupQueue[1];
+static int wakeupQueueId;
+
+static void watch_queue_event(const WatchEvent *event) {
+    eventQueue[(eventHead + eventCount) % WATCH_EVENT_QUEUE_SIZE] = *event;
+    if (eventCount < WATCH_EVENT_QUEUE_SIZE) {
+        eventCount++;
+    } else {
+        eventHead = (eventHead + 1) % WATCH_EVENT_QUEUE_SIZE;
+    }
+}
+
+static void watch_deactivate(WatchEntry *e) {
+    e->active = 0;
+    activeEntries--;
+    if (e->params.flags & WATCH_FLAG_FAST) {
+        fastEntries--;
+    }
+}
+
+// Polls the fast entries, and all others when slow is set. Returns the number of events stored in events.
+static u32 watch_poll_entries(WatchEvent *events, int slow) {
+    u32 count = 0;
+    u32 now   = ticks_to_us(timer_ticks());
+
+    for (u32 i = 0; i < WATCH_MAX_ENTRIES; i++) {
+        WatchEntry *e = &entries[i];
+        if (!e->active || (!slow && !(e->params.flags & WATCH_FLAG_FAST))) {
+            continue;
+        }
+
+        vu32 *addr = (vu32 *) e->params.address;
+        svcInvalidateDCache((void *) (e->params.address & ~(WATCH_CACHE_LINE - 1)), WATCH_CACHE_LINE);
+        u32 value = *addr;
+
+        if ((value ^ e->last) & e->params.mask) {
+            if (value == 0 && (e->params.flags & WATCH_FLAG_IGNORE_ZERO)) {
+                e->last = value;
+            } else {
+                WatchEvent *event = &events[count++];
+                event->address    = e->params.address;
+                event->old_value  = e->last;
+                event->new_value  = value;
+                event->timestamp  = now;
+                watch_queue_event(event);
+
+                e->last = value;
+                if (e->params.action != WATCH_ACTION_NONE) {
+                    *addr = e->params.action_value;
+                    svcFlushDCache((void *) (e->params.address & ~(WATCH_CACHE_LINE - 1)), WATCH_CACHE_LINE);
+                    e->last = e->params.action_value;
+                    if (e->params.action == WATCH_ACTION_WRITE_ONCE) {
+                        watch_deactivate(e);
+                        continue;
+                    }
+                }
+            }
+        }
+
+        if (e->params.max_polls && ++e->polls >= e->params.max_polls) {
+            watch_deactivate(e);
+        }
+    }
+    return count;
+}
+
+static int watch_thread(void *arg) {
+    WatchEvent events[WATCH_MAX_ENTRIES];
+    int sockets[WATCH_MAX_SUBSCRIBERS];
+
+    while (1) {
+        if (!activeEntries) {
+            ipcmessage *dummy;
+            svcReceiveMessage(wakeupQueueId, &dummy, 0);
+            continue;
+        }
+
+        mutex_lock(&watchMutex);
+        u32 now  = timer_ticks();
+        int slow = ticks_to_us(now - lastSlowPoll) >= interval;
+        if (slow) {
+            lastSlowPoll = now;
+        }
+        u32 count = watch_poll_entries(events, slow);
+        memcpy(sockets, subscribers, sizeof(sockets));
+        u32 sleep = (fastEntries && interval > WATCH_FAST_INTERVAL) ? WATCH_FAST_INTERVAL : interval;
+        mutex_unlock(&watchMutex);
+
+        if (count) {
+            for (u32 i = 0; i < WATCH_MAX_SUBSCRIBERS; i++) {
+                if (sockets[i] >= 0 && send(sockets[i], events, count * sizeof(WatchEvent), 0) < 0) {
+                    mutex_lock(&watchMutex);
+                    subscribers[i] = -1;
+                    mutex_unlock(&watchMutex);
+                    closesocket(sockets[i]);
+                }
+            }
+        }
+
+        usleep(sleep);
+    }
+    return 0;
+}
+
+void watch_init(void) {
+    interval = WATCH_DEFAULT_INTERVAL;
+    for (u32 i = 0; i < WATCH_MAX_SUBSCRIBERS; i++) {
+        subscribers[i] = -1;
+    }
+
+    mutex_init(&watchMutex);
+    wakeupQueueId = svcCreateMessageQueue(wakeupQueue, 1);
+
+    u8 *stack = (u8 *) heap_alloc_align(WATCH_THREAD_STACK_SIZE, 0x20);
+    if (!stack) {
+        return;
+    }
+    int threadId = svcCreateThread(watch_thread, 0, (u32 *) (stack + WATCH_THREAD_STACK_SIZE), WATCH_THREAD_STACK_SIZE, 0x78, 1);
+    if (threadId >= 0)
+        svcStartThread(threadId);
+}
+
+int watch_add(const WatchParams *params) {
+    if (params->address & 3) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+
+    int id = IOS_ERROR_UNKNOWN;
+    mutex_lock(&watchMutex);
+    for (u32 i = 0; i < WATCH_MAX_ENTRIES; i++) {
+        WatchEntry *e = &entries[i];
+        if (!e->active) {
+            e->params = *params;
+            svcInvalidateDCache((void *) (params->address & ~(WATCH_CACHE_LINE - 1)), WATCH_CACHE_LINE);
+            e->last   = *(vu32 *) params->address;
+            e->polls  = 0;
+            e->active = 1;
+            activeEntries++;
+            if (params->flags & WATCH_FLAG_FAST) {
+                fastEntries++;
+            }
+            id = i;
+            break;
+        }
+    }
+    mutex_unlock(&watchMutex);
+
+    if (id >= 0) {
+        // wake up the watch thread, does not block if a wakeup is pending already
+        svcSendMessage(wakeupQueueId, 0, 1);
+    }
+    return id;
+}
+
+int watch_remove(int id) {
+    if (id >= WATCH_MAX_ENTRIES) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+
+    mutex_lock(&watchMutex);
+    for (u32 i = 0; i < WATCH_MAX_ENTRIES; i++) {
+        if ((id < 0 || i == id) && entries[i].active) {
+            watch_deactivate(&entries[i]);
+        }
+    }
+    mutex_unlock(&watchMutex);
+    return 0;
+}
+
+int watch_set_interval(u32 interval_us) {
+    if (interval_us < WATCH_MIN_INTERVAL) {
+        return IOS_ERROR_INVALID_ARG;
+    }
+    interval = interval_us;
+    return 0;
+}
+
+int watch_poll(WatchEvent *events, u32 max_events) {
+    u32 count = 0;
+    mutex_lock(&watchMutex);
+    while (eventCount && count < max_events) {
+        events[count++] = eventQueue[eventHead];
+        eventHead       = (eventHead + 1) % WATCH_EVENT_QUEUE_SIZE;
+        eventCount--;
+    }
+    mutex_unlock(&watchMutex);
+    return count;
+}
+
+int watch_repeated_write(u32 address, u32 value, u32 n) {
+    WatchParams params;
+    params.address      = address;
+    params.mask         = 0xFFFFFFFF;
+    params.flags        = WATCH_FLAG_IGNORE_ZERO | WATCH_FLAG_FAST;
+    params.action       = WATCH_ACTION_WRITE_ONCE;
+    params.action_value = value;
+    params.max_polls    = n;
+    return (n == 0) ? 0 : watch_add(&params);
+}
+
+int watch_subscribe(int sock) {
+    int res = IOS_ERROR_UNKNOWN;
+    mutex_lock(&watchMutex);
+    for (u32 i = 0; i < WATCH_MAX_SUBSCRIBERS; i++) {
+        if (subscribers[i] < 0) {
+            // confirmed while holding the lock so no event can be sent before it
+            res = 0;
+            if (send(sock, &res, sizeof(res), 0) < 0) {
+                res = IOS_ERROR_UNKNOWN;
+            } else {
+                subscribers[i] = sock;
+            }
+            break;
+        }
+    }
+    mutex_unlock(&watchMutex);
+    return res;
+}
@@ -0,0 +1,93 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "imports.h"
+#include "svc.h"
+#include "types.h"
+
+#define WATCH_MAX_ENTRIES       32
+#define WATCH_MAX_SUBSCRIBERS   4
+#define WATCH_EVENT_QUEUE_SIZE  64
+#define WATCH_DEFAULT_INTERVAL  1000 // us
+#define WATCH_FAST_INTERVAL     50   // us, for WATCH_FLAG_FAST entries
+#define WATCH_MIN_INTERVAL      WATCH_FAST_INTERVAL // us, shorter intervals would keep the MCP busy polling
+
+#define WATCH_ACTION_NONE       0
+#define WATCH_ACTION_WRITE_ONCE 1 // write action_value on the first change, then remove the watch
+#define WATCH_ACTION_WRITE      2 // write action_value on every change
+
+#define WATCH_FLAG_IGNORE_ZERO  0x01 // a change to 0 only updates the old value, like the old repeated-write
+#define WATCH_FLAG_FAST         0x02 // polled every WATCH_FAST_INTERVAL, other entries keep the normal interval
+
+typedef struct WatchParams {
+    u32 address; // u32 aligned
+    u32 mask;    // bits that are compared
+    u32 flags;
+    u32 action;
+    u32 action_value;
+    u32 max_polls; // the watch is removed after this many polls, 0 = never
+} WatchParams;
+
+typedef struct WatchEvent {
+    u32 address;
+    u32 old_value;
+    u32 new_value;
+    u32 timestamp; // us, wraps around
+} WatchEvent;
+
+#ifdef MOCHA_WATCH
+
+#define WATCH_THREAD_STACK_SIZE 0x800
+#define WATCH_HEAP_SIZE         HEAP_BLOCK_SIZE(WATCH_THREAD_STACK_SIZE, 0x20)
+
+void watch_init(void);
+
+// Returns the id of the new watch or a negative error.
+int watch_add(const WatchParams *params);
+
+// Removes a watch, -1 removes all of them.
+int watch_remove(int id);
+
+// Sets the poll interval, intervals below WATCH_MIN_INTERVAL are rejected.
+int watch_set_interval(u32 interval_us);
+
+// Takes up to max_events queued events, returns the number of events.
+int watch_poll(WatchEvent *events, u32 max_events);
+
+// Waits up to n polls (WATCH_FAST_INTERVAL apart) for the value at address to change to
+// something other than 0, then writes value once. Returns right away, the watch engine does the waiting.
+int watch_repeated_write(u32 address, u32 value, u32 n);
+
+// Confirms the subscription with a single 0 word, from then on all events are sent
+// to the socket as WatchEvents until sending fails and the socket is closed.
+int watch_subscribe(int sock);
+
+#else
+
+#define WATCH_HEAP_SIZE 0
+
+// without the watch engine the caller does the waiting
+static inline int watch_repeated_write(u32 address, u32 value, u32 n) {
+    u32 *dst         = (u32 *) address;
+    u32 *cache_range = (u32 *) (address & ~0xFF);
+
+    u32 old = *dst;
+    for (u32 i = 0; i < n; i++) {
+        if (*dst != old) {
+            if (*dst == 0x0) old = *dst;
+            else {
+                *dst = value;
+                svcFlushDCache(cache_range, 0x100);
+                break;
+            }
+        } else {
+            svcInvalidateDCache(cache_range, 0x100);
+            usleep(WATCH_FAST_INTERVAL);
+        }
+    }
+    return 0;
+}
+
+#endif
+
+#endif
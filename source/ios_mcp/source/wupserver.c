@@ -1,3 +1,4 @@
+#include "../../common/kernel_commands.h"
 #include "fsa.h"
 #include "imports.h"
 #include "ipc.h"
@@ -5,17 +6,24 @@
 #include "net_ifmgr_ncl.h"
 #include "socket.h"
 #include "svc.h"
+#include "watch.h"
+#include "wupserver.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#define STREAM_READ_MAX 0x10000
+
 static int serverKilled;
 static int serverSocket;
 static u8 threadStack[0x1000] __attribute__((aligned(0x20)));
+// only one client is served at a time. On the stack the buffer would take 0x600 of the thread's 0x1000
+// bytes, the deepest command (benchmark) needs about 0x500 without it.
+static u32 commandBuffer[COMMAND_BUFFER_WORDS];
 
 // overwrites command_buffer with response
-// returns length of response (or 0 for no response, negative for error)
-static int serverCommandHandler(u32 *command_buffer, u32 length) {
+// returns length of response (or 0 for no response, negative for error, CLIENT_DETACHED)
+static int serverCommandHandler(int sock, u32 *command_buffer, u32 length) {
     if (!command_buffer || !length) return -1;
 
     int out_length = 4;
@@ -78,34 +86,38 @@ static int serverCommandHandler(u32 *command_buffer, u32 length) {
             }
             break;
         case 5:
-            // repeated-write
-            // [address][value][n]
+            // repeated-write, see watch_repeated_write
+            // [cmd_id][address][value][n]
             {
-                u32 *dst         = (u32 *) command_buffer[1];
-                u32 *cache_range = (u32 *) (command_buffer[1] & ~0xFF);
-                u32 value        = command_buffer[2];
-                u32 n            = command_buffer[3];
-
-                u32 old = *dst;
-                int i;
-                for (i = 0; i < n; i++) {
-                    if (*dst != old) {
-                        if (*dst == 0x0) old = *dst;
-                        else {
-                            *dst = value;
-                            svcFlushDCache(cache_range, 0x100);
-                            break;
-                        }
-                    } else {
-                        svcInvalidateDCache(cache_range, 0x100);
-                        usleep(50);
-                    }
-                }
+                if (length < 16) return -3;
+                int res = watch_repeated_write(command_buffer[1], command_buffer[2], command_buffer[3]);
+                if (res < 0) return res;
             }
             break;
+        case 16:
+            // stream read, the data is sent straight from memory instead of through the command buffer
+            // [cmd_id][addr][length]
+            // returns [0][data]
+            {
+                if (length < 12) return -3;
+                const u8 *src = (const u8 *) command_buffer[1];
+                length        = command_buffer[2];
+                if (length > STREAM_READ_MAX) return -3;
+
+                command_buffer[0] = 0;
+                send(sock, command_buffer, 4, 0);
+                while (length) {
+                    int ret = send(sock, src, length, 0);
+                    if (ret <= 0) break;
+                    src += ret;
+                    length -= ret;
+                }
+            }
+            return 0;
         default:
-            // unknown command
-            return -2;
+            // commands of the optional features, or -2 for an unknown command
+            out_length = wupserver_ext_command(sock, command_buffer, length);
+            if (out_length < 4) return out_length;
             break;
     }
 
@@ -115,17 +127,17 @@ static int serverCommandHandler(u32 *command_buffer, u32 length) {
 }
 
 static void serverClientHandler(int sock) {
-    u32 command_buffer[0x180];
-
     while (!serverKilled) {
-        int ret = recv(sock, command_buffer, sizeof(command_buffer), 0);
+        int ret = recv(sock, commandBuffer, sizeof(commandBuffer), 0);
 
         if (ret <= 0) break;
 
-        ret = serverCommandHandler(command_buffer, ret);
+        ret = serverCommandHandler(sock, commandBuffer, ret);
 
-        if (ret > 0) {
-            send(sock, command_buffer, ret, 0);
+        if (ret == CLIENT_DETACHED) {
+            return;
+        } else if (ret > 0) {
+            send(sock, commandBuffer, ret, 0);
         } else if (ret < 0) {
             send(sock, &ret, sizeof(int), 0);
         }
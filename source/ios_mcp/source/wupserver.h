@@ -1,8 +1,23 @@
 #ifndef WUPSERVER_H
 #define WUPSERVER_H
 
+#include "types.h"
+
+#define COMMAND_BUFFER_WORDS 0x180
+#define CLIENT_DETACHED      1 // the client socket was handed over and must not be used anymore
+
 void wupserver_init(void);
 
 void wupserver_deinit(void);
 
+#ifdef MOCHA_EXT
+// Runs a command of the optional features from the extension region, see serverCommandHandler
+// for the return value. Returns -2 for an unknown command.
+int wupserver_ext_command(int sock, u32 *command_buffer, u32 length);
+#else
+static inline int wupserver_ext_command(int sock, u32 *command_buffer, u32 length) {
+    return -2;
+}
+#endif
+
 #endif
@@ -0,0 +1,294 @@
+#include "../../common/kernel_commands.h"
+#include "benchmark.h"
+#include "fsa.h"
+#include "fsa_tree.h"
+#include "hash.h"
+#include "heap.h"
+#include "imports.h"
+#include "memsearch.h"
+#include "memsnap.h"
+#include "memvec.h"
+#include "socket.h"
+#include "svc.h"
+#include "vm.h"
+#include "watch.h"
+#include "wupserver.h"
+#include <string.h>
+
+// Commands of the optional features, called by serverCommandHandler for every command it does not know.
+int wupserver_ext_command(int sock, u32 *command_buffer, u32 length) {
+    int out_length = 4;
+
+    switch (command_buffer[0]) {
+#ifdef MOCHA_BENCHMARK
+        case 6:
+            // benchmark
+            // [cmd_id][BenchParams]
+            {
+                if (length < 4 + sizeof(BenchParams)) return -3;
+
+                BenchResult result;
+                bench_run((BenchParams *) &command_buffer[1], &result);
+
+                memcpy(&command_buffer[1], &result, sizeof(result));
+                out_length = 4 + sizeof(result);
+            }
+            break;
+#endif
+#ifdef MOCHA_MEMTOOLS
+        case 7:
+            // snapshot
+            // [cmd_id][slot][addr][size][flags]
+            {
+                out_length        = 8;
+                command_buffer[1] = memsnap_take(command_buffer[1], command_buffer[2], command_buffer[3], command_buffer[4]);
+            }
+            break;
+        case 8:
+            // diff
+            // [cmd_id][slot][filter][flags][offset]
+            // returns [result][next_offset][records...]
+            {
+                u32 slot   = command_buffer[1];
+                u32 filter = command_buffer[2];
+                u32 flags  = command_buffer[3];
+                u32 offset = command_buffer[4];
+
+                int res = memsnap_diff(slot, filter, flags, offset, &command_buffer[3], (COMMAND_BUFFER_WORDS - 3) * 4, &command_buffer[2]);
+
+                command_buffer[1] = res;
+                out_length        = 12 + ((res > 0) ? res : 0);
+            }
+            break;
+        case 9:
+            // search
+            // [cmd_id][MemSearchParams][pattern][mask]
+            // returns [result][next_address][addresses...]
+            {
+                u32 params[(sizeof(MemSearchParams) + MEMSEARCH_MAX_PATTERN_SIZE * 2) / 4];
+                MemSearchParams *p = (MemSearchParams *) params;
+                if (length < 4 + sizeof(MemSearchParams)) return -3;
+
+                memcpy(p, &command_buffer[1], sizeof(MemSearchParams));
+                if (p->pattern_length > MEMSEARCH_MAX_PATTERN_SIZE || length < 4 + sizeof(MemSearchParams) + p->pattern_length * 2) return -3;
+                memcpy(p->pattern, (u8 *) &command_buffer[1] + sizeof(MemSearchParams), p->pattern_length * 2);
+
+                u32 next_address;
+                int res = memsearch_run(p, &command_buffer[3], COMMAND_BUFFER_WORDS - 3, &next_address);
+
+                command_buffer[1] = res;
+                command_buffer[2] = next_address;
+                out_length        = 12 + ((res > 0) ? res * 4 : 0);
+            }
+            break;
+#endif
+#ifdef MOCHA_WATCH
+        case 10:
+            // watch add
+            // [cmd_id][WatchParams]
+            // returns [id]
+            {
+                WatchParams params;
+                if (length < 4 + sizeof(WatchParams)) return -3;
+
+                memcpy(&params, &command_buffer[1], sizeof(params));
+                command_buffer[1] = watch_add(&params);
+                out_length        = 8;
+            }
+            break;
+        case 11:
+            // watch remove
+            // [cmd_id][id], -1 removes all watches
+            {
+                if (length < 8) return -3;
+                watch_remove((int) command_buffer[1]);
+            }
+            break;
+        case 12:
+            // watch subscribe
+            // [cmd_id]
+            // returns [0] followed by a stream of WatchEvents, the connection takes no more commands
+            {
+                int res = watch_subscribe(sock);
+                if (res < 0) return res;
+                return CLIENT_DETACHED;
+            }
+            break;
+        case 13:
+            // watch interval
+            // [cmd_id][interval_us]
+            {
+                if (length < 8) return -3;
+                if (watch_set_interval(command_buffer[1]) < 0) return -3;
+            }
+            break;
+#endif
+#ifdef MOCHA_MEMTOOLS
+        case 14:
+            // kernel read
+            // [cmd_id][addr][length]
+            {
+                if (length < 12) return -3;
+                length = command_buffer[2];
+                if (length > (COMMAND_BUFFER_WORDS - 1) * 4) return -3;
+
+                svcCustomKernelCommand(KERNEL_MEMCPY, &command_buffer[1], command_buffer[1], length);
+                out_length = length + 4;
+            }
+            break;
+        case 15:
+            // kernel write
+            // [cmd_id][addr][data]
+            {
+                if (length < 8) return -3;
+                svcCustomKernelCommand(KERNEL_MEMCPY, command_buffer[1], &command_buffer[2], length - 8);
+            }
+            break;
+#endif
+#ifdef MOCHA_VM
+        case 17:
+            // run script, see vm.h
+            // [cmd_id][max_steps][script]
+            // returns [result][output]
+            {
+                if (length < 16) return -3;
+                u32 script_size = length - 8;
+
+                // the output overwrites command_buffer, so the script runs from a copy
+                u32 *script = (u32 *) heap_alloc_align(script_size, 0x20);
+                if (!script) return -1;
+                memcpy(script, &command_buffer[2], script_size);
+
+                u32 out_size;
+                int res = vm_run(script, script_size, command_buffer[1], (u8 *) &command_buffer[2], (COMMAND_BUFFER_WORDS - 2) * 4, &out_size, &command_buffer[1]);
+                heap_free(script);
+                if (res < 0) return res;
+
+                out_length = 8 + out_size;
+            }
+            break;
+#endif
+#ifdef MOCHA_FSA_TOOLS
+        case 18:
+            // hash
+            // [cmd_id][HashParams]
+            {
+                if (length < 4 + sizeof(HashParams)) return -3;
+
+                HashResult result;
+                hash_run((HashParams *) &command_buffer[1], &result);
+
+                memcpy(&command_buffer[1], &result, sizeof(result));
+                out_length = 4 + sizeof(result);
+            }
+            break;
+        case 19:
+            // remove recursively
+            // [cmd_id][path]
+            // returns [removed entries or result]
+            {
+                if (length < 8) return -3;
+                ((char *) command_buffer)[length - 1] = '\0';
+
+                int fd = svcOpen("/dev/fsa", 0);
+                if (fd < 0) return fd;
+                command_buffer[1] = fsa_tree_remove(fd, (char *) &command_buffer[1]);
+                svcClose(fd);
+
+                out_length = 8;
+            }
+            break;
+        case 20:
+            // make directories
+            // [cmd_id][mode][path]
+            // returns [created directories or result]
+            {
+                if (length < 12) return -3;
+                ((char *) command_buffer)[length - 1] = '\0';
+
+                int fd = svcOpen("/dev/fsa", 0);
+                if (fd < 0) return fd;
+                command_buffer[1] = fsa_tree_make_dirs(fd, (char *) &command_buffer[2], command_buffer[1]);
+                svcClose(fd);
+
+                out_length = 8;
+            }
+            break;
+#endif
+#ifdef MOCHA_MEMTOOLS
+        case 21:
+            // read many regions
+            // [cmd_id][MemVecEntry]...
+            // returns [result][data of all entries]
+            {
+                u32 count = (length - 4) / sizeof(MemVecEntry);
+                if (count == 0) return -3;
+
+                // the data overwrites command_buffer, so the entries are read from a copy
+                MemVecEntry *entries = (MemVecEntry *) heap_alloc(count * sizeof(MemVecEntry));
+                if (!entries) return -1;
+                memcpy(entries, &command_buffer[1], count * sizeof(MemVecEntry));
+
+                int res = memvec_read(entries, count, &command_buffer[2], (COMMAND_BUFFER_WORDS - 2) * 4);
+                heap_free(entries);
+
+                command_buffer[1] = res;
+                out_length        = 8 + ((res > 0) ? res : 0);
+            }
+            break;
+        case 22:
+            // write many regions
+            // [cmd_id][count][MemVecEntry x count][data of all entries]
+            {
+                if (length < 8) return -3;
+                u32 count = command_buffer[1];
+                if (count > (length - 8) / sizeof(MemVecEntry)) return -3;
+                u32 used = 8 + count * sizeof(MemVecEntry);
+
+                int res = memvec_write((MemVecEntry *) &command_buffer[2], count, ((u8 *) command_buffer) + used, length - used);
+                if (res < 0) return res;
+            }
+            break;
+#endif
+#ifdef MOCHA_HEAP
+        case 23:
+            // heap stats
+            // returns [HeapStats]
+            {
+                heap_get_stats((HeapStats *) &command_buffer[1]);
+                out_length = 4 + sizeof(HeapStats);
+            }
+            break;
+        case 24:
+            // alloc from the mocha heap
+            // [cmd_id][size][align]
+            // returns [address], 0 when the private heap is full
+            {
+                if (length < 12) return -3;
+                // only blocks of the private heap can be checked when they are freed again
+                void *ptr = heap_alloc_align(command_buffer[1], command_buffer[2]);
+                if (ptr && !heap_contains(ptr)) {
+                    heap_free(ptr);
+                    ptr = NULL;
+                }
+                command_buffer[1] = (u32) ptr;
+                out_length        = 8;
+            }
+            break;
+        case 25:
+            // free to the mocha heap
+            // [cmd_id][address], the address has to come from cmd 24
+            {
+                if (length < 8) return -3;
+                if (!heap_contains((void *) command_buffer[1])) return -3;
+                heap_free((void *) command_buffer[1]);
+            }
+            break;
+#endif
+        default:
+            // unknown command
+            return -2;
+    }
+
+    return out_length;
+}
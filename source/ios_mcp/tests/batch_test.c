@@ -0,0 +1,238 @@
+// Argument parsing of IOCTL_FSA_BATCH. ipc_ext.c is included for FSABatchOp, the ops are run by
+// the ipc_ioctl below, which records them instead of calling FSA.
+#include "../source/ipc_ext.c"
+#include "host.h"
+
+#define TEST_SESSION 5
+#define TEST_HANDLE  0x1234
+
+static u32 input[0x100];
+static u32 inputLength;
+static u32 output[0x100];
+
+static u32 calls;
+static u32 callCommands[8];
+static u32 callWords[8][6];
+static u32 *callOutputs[8];
+
+int ipc_ioctl(ipcmessage *message) {
+    CHECK(message->fd == TEST_SESSION);
+    if (calls < 8) {
+        callCommands[calls] = message->ioctl.command;
+        callOutputs[calls]  = message->ioctl.buffer_io;
+        memcpy(callWords[calls], message->ioctl.buffer_in, message->ioctl.length_in < 24 ? message->ioctl.length_in : 24);
+    }
+    calls++;
+
+    u32 *io = message->ioctl.buffer_io;
+    switch (message->ioctl.command) {
+        case IOCTL_FSA_OPENFILE:
+            io[0] = 0;
+            io[1] = TEST_HANDLE;
+            break;
+        case IOCTL_FSA_READFILE:
+            io[0] = message->ioctl.buffer_in[2];
+            break;
+        case IOCTL_FSA_GETSTAT:
+            io[0] = FSA_STATUS_NOT_FOUND;
+            break;
+        default:
+            io[0] = 0;
+            break;
+    }
+    return 0;
+}
+
+int FSA_ReadDir(int fd, int handle, FSDirectory *out_data) {
+    return -1;
+}
+
+static void batch_begin(u32 count, u32 flags) {
+    memset(input, 0, sizeof(input));
+    memset(output, 0xEE, sizeof(output));
+    input[0]    = count;
+    input[1]    = flags;
+    inputLength = 8;
+    calls       = 0;
+}
+
+// Appends an op with words argument words, zero until set with op_in(op)[i].
+static FSABatchOp *batch_op(u32 command, u32 words, u32 length_io, u32 link) {
+    FSABatchOp *op = (FSABatchOp *) ((u8 *) input + inputLength);
+    op->command    = command;
+    op->length_in  = words * 4;
+    op->length_io  = length_io;
+    op->link       = link;
+    inputLength += sizeof(FSABatchOp) + op->length_in;
+    return op;
+}
+
+static u32 *op_in(FSABatchOp *op) {
+    return (u32 *) (op + 1);
+}
+
+// Appends a string to the input of the last op and points word at it.
+static void op_string(FSABatchOp *op, u32 word, const char *str) {
+    u32 length        = (strlen(str) + 1 + 3) & ~3;
+    op_in(op)[word]   = op->length_in;
+    memcpy((u8 *) op_in(op) + op->length_in, str, strlen(str) + 1);
+    op->length_in += length;
+    inputLength += length;
+}
+
+static int batch_run(u32 length_io) {
+    ipcmessage message;
+    memset(&message, 0, sizeof(message));
+    message.command         = IOS_IOCTL;
+    message.fd              = TEST_SESSION;
+    message.ioctl.command   = IOCTL_FSA_BATCH;
+    message.ioctl.buffer_in = input;
+    message.ioctl.length_in = inputLength;
+    message.ioctl.buffer_io = output;
+    message.ioctl.length_io = length_io;
+    return ipc_ext_ioctl(&message);
+}
+
+static void test_header(void) {
+    batch_begin(1, 0);
+    CHECK(batch_run(sizeof(output)) == IOS_ERROR_INVALID_SIZE); // no room for the op
+
+    batch_begin(0, 0);
+    CHECK(batch_run(sizeof(output)) == IOS_ERROR_INVALID_SIZE);
+
+    batch_begin(FSA_BATCH_MAX_OPS + 1, 0);
+    CHECK(batch_run(sizeof(output)) == IOS_ERROR_INVALID_SIZE);
+
+    batch_begin(2, 0);
+    batch_op(IOCTL_FSA_CLOSE, 1, 4, 0);
+    batch_op(IOCTL_FSA_CLOSE, 1, 4, 0);
+    CHECK(batch_run(4 + 4) == IOS_ERROR_INVALID_SIZE); // one result word is missing
+
+    // the second op claims more input than there is
+    batch_begin(2, 0);
+    batch_op(IOCTL_FSA_CLOSE, 1, 4, 0);
+    FSABatchOp *op = batch_op(IOCTL_FSA_CLOSE, 1, 4, 0);
+    op->length_in  = 0x100;
+    CHECK(batch_run(sizeof(output)) == IOS_ERROR_INVALID_SIZE);
+    CHECK(output[0] == 1);
+    CHECK(calls == 1);
+
+    batch_begin(1, 0);
+    op            = batch_op(IOCTL_FSA_CLOSE, 1, 4, 0);
+    op->length_in = 2;
+    CHECK(batch_run(sizeof(output)) == IOS_ERROR_INVALID_SIZE);
+    CHECK(calls == 0);
+
+    // the output of an op has to fit behind the results
+    batch_begin(1, 0);
+    batch_op(IOCTL_FSA_CLOSE, 1, 0x80, 0);
+    CHECK(batch_run(0x80) == IOS_ERROR_INVALID_SIZE);
+}
+
+// the handle of an OPENFILE is linked into the READFILE after it, every output is 0x40 aligned
+static void test_link(void) {
+    batch_begin(2, 0);
+    FSABatchOp *open = batch_op(IOCTL_FSA_OPENFILE, 3, 8, 0);
+    op_in(open)[0]   = 3;
+    op_in(open)[1]   = 0;
+    op_string(open, 1, "/vol/external01/a.bin");
+    op_string(open, 2, "r");
+    FSABatchOp *read = batch_op(IOCTL_FSA_READFILE, 5, 0x40 + 0x10, (1 << 16) | (1 << 8) | 3);
+    op_in(read)[0]   = 3;
+    op_in(read)[1]   = 1;
+    op_in(read)[2]   = 0x10;
+
+    CHECK(batch_run(sizeof(output)) == 0);
+    CHECK(output[0] == 2);
+    CHECK(output[1] == 0);
+    CHECK(output[2] == 0x10);
+    CHECK(calls == 2);
+    CHECK(callCommands[0] == IOCTL_FSA_OPENFILE);
+    CHECK(callCommands[1] == IOCTL_FSA_READFILE);
+    CHECK(callWords[1][3] == TEST_HANDLE);
+    CHECK(callOutputs[0] == output + 0x40 / 4);
+    CHECK(callOutputs[1] == output + 0x80 / 4);
+    // the client's input is not patched, the linked copy is freed again
+    CHECK(op_in(read)[3] == 0);
+    CHECK(host_allocs == 0);
+}
+
+static void test_bad_links(void) {
+    batch_begin(4, 0);
+    FSABatchOp *stat = batch_op(IOCTL_FSA_GETSTAT, 2, 4 + sizeof(FSStat), 0);
+    op_string(stat, 1, "/vol/missing");
+    batch_op(IOCTL_FSA_CLOSE, 1, 4, (1 << 16) | (0 << 8) | 0);    // links to the failed GETSTAT
+    batch_op(IOCTL_FSA_CLOSE, 1, 4, (3 << 16) | (0 << 8) | 0);    // links to itself
+    batch_op(IOCTL_FSA_CLOSE, 1, 4, (1 << 16) | (0x40 << 8) | 0); // word past the output of op 0
+
+    CHECK(batch_run(sizeof(output)) == 0);
+    CHECK(output[0] == 4);
+    CHECK((int) output[1] == FSA_STATUS_NOT_FOUND);
+    CHECK((int) output[2] == FSA_STATUS_NOT_FOUND);
+    CHECK((int) output[3] == IOS_ERROR_INVALID_ARG);
+    CHECK((int) output[4] == IOS_ERROR_INVALID_ARG);
+    CHECK(calls == 1);
+
+    // the same with FSA_BATCH_FLAG_STOP_ON_ERROR ends after the GETSTAT
+    input[1] = FSA_BATCH_FLAG_STOP_ON_ERROR;
+    calls    = 0;
+    CHECK(batch_run(sizeof(output)) == 0);
+    CHECK(output[0] == 1);
+    CHECK(calls == 1);
+}
+
+static void test_arguments(void) {
+    batch_begin(7, 0);
+    batch_op(0x30, 0, 4, 0); // not an FSA command
+
+    FSABatchOp *op = batch_op(IOCTL_FSA_GETSTAT, 2, 4 + sizeof(FSStat), 0);
+    op_in(op)[1]   = 0x100; // path outside of the input
+
+    op             = batch_op(IOCTL_FSA_GETSTAT, 3, 4 + sizeof(FSStat), 0);
+    op_in(op)[1]   = 8;
+    op_in(op)[2]   = 0x41414141; // path without a terminator
+
+    op = batch_op(IOCTL_FSA_GETSTAT, 2, 4, 0); // no room for the FSStat
+    op_string(op, 1, "/vol");
+
+    op           = batch_op(IOCTL_FSA_READFILE, 5, 0x40 + 0x80, 0);
+    op_in(op)[1] = 0x10;
+    op_in(op)[2] = 0x10; // 0x100 bytes do not fit
+
+    op           = batch_op(IOCTL_FSA_WRITEFILE, 0x40 / 4, 4, 0);
+    op_in(op)[1] = 1;
+    op_in(op)[2] = 0x10; // the data behind 0x40 is missing
+
+    op = batch_op(IOCTL_FSA_SETPOSFILE, 2, 4, 0); // the position is missing
+
+    CHECK(batch_run(sizeof(output)) == 0);
+    CHECK(output[0] == 7);
+    CHECK((int) output[1] == IOS_ERROR_INVALID_ARG);
+    for (u32 i = 2; i <= 7; i++) {
+        CHECK((int) output[i] == IOS_ERROR_INVALID_SIZE);
+    }
+    CHECK(calls == 0);
+
+    // with the data and the position they go through
+    batch_begin(2, 0);
+    op           = batch_op(IOCTL_FSA_WRITEFILE, (0x40 + 0x10) / 4, 4, 0);
+    op_in(op)[1] = 1;
+    op_in(op)[2] = 0x10;
+    batch_op(IOCTL_FSA_SETPOSFILE, 3, 4, 0);
+    CHECK(batch_run(sizeof(output)) == 0);
+    CHECK(output[0] == 2);
+    CHECK(output[1] == 0);
+    CHECK(output[2] == 0);
+    CHECK(calls == 2);
+}
+
+int main(void) {
+    host_init();
+
+    test_header();
+    test_link();
+    test_bad_links();
+    test_arguments();
+
+    return host_report("batch_test");
+}
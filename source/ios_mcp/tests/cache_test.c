@@ -0,0 +1,334 @@
+// Invalidation of the stat cache and the read-ahead cache. The FSA calls go to a file system of
+// a few files in memory, the tests call the caches the way ipc_fsa.c does.
+#include "../source/filecache.h"
+#include "../source/statcache.h"
+#include "../source/utils.h"
+#include "host.h"
+#include <string.h>
+
+#define TEST_FD     3
+#define FILE_SIZE   0x1000
+#define MAX_FILES   16
+#define MAX_HANDLES 16
+
+typedef struct {
+    const char *path;
+    u8 data[FILE_SIZE];
+} TestFile;
+
+typedef struct {
+    TestFile *file;
+    u32 pos;
+} TestHandle;
+
+static TestFile files[MAX_FILES];
+static TestHandle fileHandles[MAX_HANDLES];
+static u32 getStatCalls;
+static u32 fileReads;
+static void (*getStatHook)(void);
+
+static TestFile *test_find(const char *path) {
+    for (u32 i = 0; i < MAX_FILES; i++) {
+        if (files[i].path && strcmp(files[i].path, path) == 0) {
+            return &files[i];
+        }
+    }
+    return NULL;
+}
+
+static int test_open(const char *path, u8 fill) {
+    TestFile *f = test_find(path);
+    for (u32 i = 0; !f && i < MAX_FILES; i++) {
+        if (!files[i].path) {
+            f       = &files[i];
+            f->path = path;
+        }
+    }
+    memset(f->data, fill, FILE_SIZE);
+    for (int i = 0; i < MAX_HANDLES; i++) {
+        if (!fileHandles[i].file) {
+            fileHandles[i].file = f;
+            fileHandles[i].pos  = 0;
+            return i + 0x100;
+        }
+    }
+    return -1;
+}
+
+static TestHandle *test_handle(int fileHandle) {
+    return &fileHandles[fileHandle - 0x100];
+}
+
+int FSA_GetStat(int fd, char *path, FSStat *out_data) {
+    getStatCalls++;
+    if (getStatHook) {
+        getStatHook();
+    }
+    memset(out_data, 0, sizeof(FSStat));
+    TestFile *f = test_find(path);
+    if (!f) {
+        return FSA_STATUS_NOT_FOUND;
+    }
+    out_data->size = FILE_SIZE;
+    return 0;
+}
+
+int FSA_ReadFileWithPos(int fd, void *data, u32 size, u32 cnt, u32 position, int fileHandle, u32 flags) {
+    TestHandle *h = test_handle(fileHandle);
+    u32 length    = size * cnt;
+    if (position > FILE_SIZE) {
+        position = FILE_SIZE;
+    }
+    if (length > FILE_SIZE - position) {
+        length = FILE_SIZE - position;
+    }
+    memcpy(data, h->file->data + position, length);
+    fileReads++;
+    return length / size;
+}
+
+int FSA_ReadFile(int fd, void *data, u32 size, u32 cnt, int fileHandle, u32 flags) {
+    TestHandle *h = test_handle(fileHandle);
+    int res       = FSA_ReadFileWithPos(fd, data, size, cnt, h->pos, fileHandle, flags);
+    h->pos += res * size;
+    return res;
+}
+
+int FSA_WriteFileWithPos(int fd, void *data, u32 size, u32 cnt, u32 position, int fileHandle, u32 flags) {
+    TestHandle *h = test_handle(fileHandle);
+    memcpy(h->file->data + position, data, size * cnt);
+    return cnt;
+}
+
+int FSA_WriteFile(int fd, void *data, u32 size, u32 cnt, int fileHandle, u32 flags) {
+    TestHandle *h = test_handle(fileHandle);
+    int res       = FSA_WriteFileWithPos(fd, data, size, cnt, h->pos, fileHandle, flags);
+    h->pos += res * size;
+    return res;
+}
+
+int FSA_GetPosFile(int fd, int fileHandle, u32 *out_position) {
+    *out_position = test_handle(fileHandle)->pos;
+    return 0;
+}
+
+int FSA_SetPosFile(int fd, int fileHandle, u32 position) {
+    test_handle(fileHandle)->pos = position;
+    return 0;
+}
+
+// IOCTL_FSA_OPENFILE
+static int cache_open(char *path, char *mode, u8 fill) {
+    int handle = test_open(path, fill);
+    statcache_open_file(TEST_FD, handle, path, mode);
+    filecache_open_file(path, mode);
+    return handle;
+}
+
+// IOCTL_FSA_READFILE, returns the first byte that was read
+static u8 cache_read(int handle, u32 length) {
+    u8 data[0x100];
+    CHECK(filecache_read(TEST_FD, data, 1, length, FILECACHE_CURRENT_POS, handle, 0) == (int) length);
+    return data[0];
+}
+
+// IOCTL_FSA_WRITEFILE
+static void cache_write(int handle, u8 value, u32 length) {
+    u8 data[0x100];
+    memset(data, value, length);
+    CHECK(filecache_write(TEST_FD, data, 1, length, FILECACHE_CURRENT_POS, handle, 0) == (int) length);
+    statcache_file_changed(TEST_FD, handle, 0);
+    filecache_file_changed(TEST_FD, handle);
+}
+
+// IOCTL_FSA_CLOSEFILE
+static void cache_close(int handle) {
+    filecache_sync(TEST_FD, handle, FILECACHE_SYNC_CLOSE);
+    statcache_file_changed(TEST_FD, handle, 1);
+    test_handle(handle)->file = NULL;
+}
+
+static int cache_stat(char *path) {
+    FSStat stat;
+    return statcache_get_stat(TEST_FD, path, &stat);
+}
+
+// Reads until handle reads ahead, the data of the next read is in memory afterwards.
+static void cache_read_ahead(int handle) {
+    for (u32 i = 0; i <= FILECACHE_SEQUENTIAL_READS; i++) {
+        cache_read(handle, 0x20);
+    }
+    u32 reads = fileReads;
+    cache_read(handle, 0x20);
+    CHECK(fileReads == reads);
+}
+
+static void test_stat_paths(void) {
+    test_open("/vol/a/dir/file", 0);
+    test_open("/vol/a/dirx", 0);
+
+    char *paths[] = {"/vol/a", "/vol/a/dir", "/vol/a/dir/file", "/vol/a/dirx", "/vol/a/missing"};
+    for (u32 i = 0; i < 5; i++) {
+        cache_stat(paths[i]);
+    }
+    u32 calls = getStatCalls;
+    for (u32 i = 0; i < 5; i++) {
+        cache_stat(paths[i]);
+    }
+    CHECK(getStatCalls == calls);
+    CHECK(cache_stat("/vol/a/missing") == FSA_STATUS_NOT_FOUND);
+
+    // a remove of /vol/a/dir drops it, everything below it and its parent, but not /vol/a/dirx
+    statcache_invalidate_path("/vol/a/dir");
+    calls = getStatCalls;
+    cache_stat("/vol/a/dirx");
+    cache_stat("/vol/a/missing");
+    CHECK(getStatCalls == calls);
+    cache_stat("/vol/a");
+    cache_stat("/vol/a/dir");
+    cache_stat("/vol/a/dir/file");
+    CHECK(getStatCalls == calls + 3);
+
+    // a relative path drops everything
+    statcache_invalidate_path("dir");
+    calls = getStatCalls;
+    cache_stat("/vol/a/dirx");
+    CHECK(getStatCalls == calls + 1);
+
+    // entries expire after the TTL
+    calls = getStatCalls;
+    cache_stat("/vol/a/dirx");
+    *host_timer += STATCACHE_TTL * (LT_TIMER_TICKS_PER_SEC / 1000);
+    cache_stat("/vol/a/dirx");
+    CHECK(getStatCalls == calls + 1);
+}
+
+// a stat fetched while the path changes is not cached
+static void test_stat_race_hook(void) {
+    getStatHook = NULL;
+    statcache_invalidate_path("/vol/b/file");
+}
+
+static void test_stat_race(void) {
+    test_open("/vol/b/file", 0);
+    getStatHook = test_stat_race_hook;
+    cache_stat("/vol/b/file");
+    u32 calls = getStatCalls;
+    cache_stat("/vol/b/file");
+    CHECK(getStatCalls == calls + 1);
+}
+
+static void test_stat_files(void) {
+    int handle = cache_open("/vol/c/file", "r", 0);
+    cache_stat("/vol/c/file");
+    cache_stat("/vol/c/other");
+
+    // a write through the handle drops the stat of its path only
+    u32 calls = getStatCalls;
+    cache_write(handle, 1, 0x10);
+    cache_stat("/vol/c/other");
+    CHECK(getStatCalls == calls);
+    cache_stat("/vol/c/file");
+    CHECK(getStatCalls == calls + 1);
+
+    // an open for writing drops the path right away
+    cache_open("/vol/c/file", "w", 0);
+    cache_stat("/vol/c/file");
+    CHECK(getStatCalls == calls + 2);
+
+    // a handle with an unknown path drops everything
+    int relative = cache_open("c/other", "r", 0);
+    cache_stat("/vol/c/other");
+    calls = getStatCalls;
+    cache_write(relative, 1, 0x10);
+    cache_stat("/vol/c/other");
+    CHECK(getStatCalls == calls + 1);
+
+    cache_close(handle);
+    cache_close(relative);
+}
+
+// read-ahead data is per handle, a change through another handle or by path drops it for all
+static void test_read_ahead(void) {
+    CHECK(filecache_configure(0x200, 4) == 0);
+
+    int a = cache_open("/vol/d/file", "r", 0xAA);
+    int b = cache_open("/vol/d/file", "r", 0xAA);
+    int c = cache_open("/vol/d/other", "r", 0xCC);
+    cache_read_ahead(a);
+    cache_read_ahead(c);
+
+    cache_write(b, 0xBB, 0x100);
+    CHECK(cache_read(a, 0x20) == 0xBB);
+    CHECK(cache_read(c, 0x20) == 0xCC);
+
+    // a rename or remove by path
+    cache_read_ahead(a);
+    memset(test_handle(a)->file->data, 0xDD, FILE_SIZE);
+    filecache_invalidate_path("/vol/d/file");
+    CHECK(cache_read(a, 0x20) == 0xDD);
+
+    // an open that truncates the file
+    cache_read_ahead(a);
+    u32 reads = fileReads;
+    int d     = cache_open("/vol/d/file", "w", 0xEE);
+    CHECK(cache_read(a, 0x20) == 0xEE);
+    CHECK(fileReads == reads + 1);
+
+    // a handle opened with a relative path may be any file
+    cache_read_ahead(c);
+    int e = cache_open("d/other", "r", 0);
+    reads = fileReads;
+    cache_write(e, 0x11, 0x100);
+    CHECK(cache_read(c, 0x20) == 0xCC);
+    CHECK(fileReads == reads + 1);
+
+    cache_close(a);
+    cache_close(b);
+    cache_close(c);
+    cache_close(d);
+    cache_close(e);
+}
+
+// buffered writes reach the file at the flush, read-ahead and stats of the file are dropped then
+static void test_write_behind(void) {
+    int reader = cache_open("/vol/e/file", "r", 0x22);
+    int writer = cache_open("/vol/e/file", "r+", 0x22);
+    CHECK(filecache_set_write_buffer(TEST_FD, writer, 0x400) == 0);
+
+    cache_read_ahead(reader);
+    cache_stat("/vol/e/file");
+
+    u8 data[0x10];
+    memset(data, 0x33, sizeof(data));
+    CHECK(filecache_write(TEST_FD, data, 1, sizeof(data), FILECACHE_CURRENT_POS, writer, 0) == sizeof(data));
+    CHECK(test_handle(writer)->file->data[0] == 0x22);
+
+    u32 calls = getStatCalls;
+    CHECK(filecache_sync(TEST_FD, writer, FILECACHE_SYNC_FLUSH) == 0);
+    CHECK(test_handle(writer)->file->data[0] == 0x33);
+    cache_stat("/vol/e/file");
+    CHECK(getStatCalls == calls + 1);
+
+    // IOCTL_FSA_SETPOSFILE
+    filecache_sync(TEST_FD, reader, FILECACHE_SYNC_SEEK);
+    FSA_SetPosFile(TEST_FD, reader, 0);
+    CHECK(cache_read(reader, 0x20) == 0x33);
+
+    cache_close(reader);
+    cache_close(writer);
+}
+
+int main(void) {
+    host_init();
+    statcache_init();
+    filecache_init();
+
+    test_stat_paths();
+    test_stat_race();
+    test_stat_files();
+    test_read_ahead();
+    test_write_behind();
+
+    return host_report("cache_test");
+}
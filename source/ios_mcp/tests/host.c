@@ -0,0 +1,125 @@
+#define _GNU_SOURCE
+#include "host.h"
+#include "../source/imports.h"
+#include "../source/svc.h"
+#include "../source/utils.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define HOST_ARENA_SIZE 0x1000000
+
+int host_allocs;
+volatile u32 *host_timer;
+void (*host_usleep_hook)(u32 time);
+
+static u8 *arena;
+static u32 arenaUsed;
+static int checks;
+static int failures;
+
+void host_init(void) {
+    // LT_TIMER is read straight from 0x0D800010
+    void *timer = mmap((void *) 0x0D800000, 0x1000, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+    arena       = mmap(NULL, HOST_ARENA_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (timer != (void *) 0x0D800000 || arena == MAP_FAILED) {
+        fprintf(stderr, "host_init: could not map the timer or the arena\n");
+        exit(2);
+    }
+    host_timer = &LT_TIMER;
+}
+
+void *host_alloc32(u32 size) {
+    return svcAllocAlign(0, size, 0x40);
+}
+
+// a bump allocator, the tests are short
+void *svcAllocAlign(u32 heapid, u32 size, u32 align) {
+    u32 start = (arenaUsed + align - 1) & ~(align - 1);
+    if (start + size > HOST_ARENA_SIZE) {
+        return NULL;
+    }
+    arenaUsed = start + size;
+    if (heapid) {
+        host_allocs++;
+    }
+    memset(arena + start, 0xA5, size);
+    return arena + start;
+}
+
+void *svcAlloc(u32 heapid, u32 size) {
+    return svcAllocAlign(heapid, size, 0x20);
+}
+
+void svcFree(u32 heapid, void *ptr) {
+    if (heapid) {
+        host_allocs--;
+    }
+}
+
+int svcInvalidateDCache(void *address, u32 size) {
+    return 0;
+}
+
+int svcFlushDCache(void *address, u32 size) {
+    return 0;
+}
+
+int svcCreateThread(int (*callback)(void *arg), void *arg, u32 *stack_top, u32 stacksize, int priority, int detached) {
+    return 1;
+}
+
+int svcStartThread(int threadId) {
+    return 0;
+}
+
+int svcCreateMessageQueue(u32 *ptr, u32 n_msgs) {
+    static int queueIds;
+    return ++queueIds;
+}
+
+int svcDestroyMessageQueue(int queueid) {
+    return 0;
+}
+
+int svcSendMessage(int queueid, u32 message, u32 flags) {
+    return 0;
+}
+
+int svcReceiveMessage(int queueid, ipcmessage **ipc_buf, u32 flags) {
+    return -1;
+}
+
+int svcResourceReply(ipcmessage *ipc_message, u32 result) {
+    return 0;
+}
+
+int mutex_init(mutex_t *mutex) {
+    return 0;
+}
+
+void mutex_lock(mutex_t *mutex) {
+}
+
+void mutex_unlock(mutex_t *mutex) {
+}
+
+void usleep(u32 time) {
+    if (host_usleep_hook) {
+        host_usleep_hook(time);
+    }
+}
+
+void host_check(int ok, const char *cond, const char *file, int line) {
+    checks++;
+    if (!ok) {
+        failures++;
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, cond);
+    }
+}
+
+int host_report(const char *name) {
+    printf("%s: %d checks, %d failed\n", name, checks, failures);
+    return failures ? 1 : 0;
+}
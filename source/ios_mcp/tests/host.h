@@ -0,0 +1,31 @@
+// Host stand-ins for the IOS services the tested ios_mcp sources use. Everything runs on one thread:
+// threads are created but never started, message queues never deliver and mutexes don't block.
+#ifndef HOST_H
+#define HOST_H
+
+#include "../source/types.h"
+
+// Maps the Starbuck timer page and the memory svcAlloc hands out below 4 GiB, ios_mcp keeps
+// addresses in u32s. Has to run before anything else.
+void host_init(void);
+
+// Memory below 4 GiB that is not tracked by host_allocs.
+void *host_alloc32(u32 size);
+
+// Blocks svcAlloc handed out that were not freed yet.
+extern int host_allocs;
+
+// LT_TIMER, advance it to let time pass.
+extern volatile u32 *host_timer;
+
+// Called by usleep instead of sleeping, so a test can act as the other side meanwhile.
+extern void (*host_usleep_hook)(u32 time);
+
+void host_check(int ok, const char *cond, const char *file, int line);
+
+// Prints the result, the exit code of the test.
+int host_report(const char *name);
+
+#define CHECK(cond) host_check(!!(cond), #cond, __FILE__, __LINE__)
+
+#endif
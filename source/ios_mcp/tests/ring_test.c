@@ -0,0 +1,132 @@
+// Index arithmetic of the submission and completion rings. ring.c is included for ring_drain,
+// the test runs it in place of the ring thread.
+#include "../source/ring.c"
+#include "host.h"
+
+#define TEST_FD 7
+
+static RingSubmission *submissions;
+static RingCompletion *completions;
+static u32 handled[16];
+static u32 handledCount;
+static u32 readCompletions; // completions the usleep hook consumed as PPC
+
+static int test_handler(ipcmessage *message) {
+    CHECK(message->fd == TEST_FD);
+    if (handledCount < 16) {
+        handled[handledCount] = message->ioctl.command;
+    }
+    handledCount++;
+    return -(int) message->ioctl.command;
+}
+
+static void test_setup(u32 entries, u32 start) {
+    u8 *mem = host_alloc32(sizeof(RingHeader) + (sizeof(RingSubmission) + sizeof(RingCompletion)) * entries);
+    memset(mem, 0, sizeof(RingHeader) + (sizeof(RingSubmission) + sizeof(RingCompletion)) * entries);
+    CHECK(ring_setup(TEST_FD, mem, entries) == 0);
+
+    submissions = (RingSubmission *) (ring + 1);
+    completions = (RingCompletion *) (submissions + entries);
+    ring->sq_head = ring->cq_tail = start;
+    ring->sq_tail = ring->cq_head = start;
+    handledCount    = 0;
+    readCompletions = 0;
+}
+
+static void test_submit(u32 command) {
+    RingSubmission *s = &submissions[ring->sq_tail & (ringEntries - 1)];
+    memset(s, 0, sizeof(RingSubmission));
+    s->command   = command;
+    s->user_data = command + 0x1000;
+    ring->sq_tail++;
+}
+
+// the indices run over 2^32 without the masked slots getting out of step
+static void test_wrap(void) {
+    test_setup(4, 0xFFFFFFFE);
+    for (u32 i = 0; i < 3; i++) {
+        test_submit(0x40 + i);
+    }
+    CHECK(ring->sq_tail == 1);
+
+    ring_drain();
+    CHECK(handledCount == 3);
+    CHECK(ring->sq_head == 1);
+    CHECK(ring->cq_tail == 1);
+    CHECK(ring->state == RING_STATE_IDLE);
+    for (u32 i = 0; i < 3; i++) {
+        RingCompletion *c = &completions[(0xFFFFFFFE + i) & 3];
+        CHECK(handled[i] == 0x40 + i);
+        CHECK(c->user_data == 0x1040 + i);
+        CHECK(c->result == -(s32) (0x40 + i));
+    }
+}
+
+// PPC reads two completions each time the thread waits for room
+static void test_read_completions(u32 time) {
+    for (u32 i = 0; i < 2 && ring->cq_head != ring->cq_tail; i++) {
+        RingCompletion *c = &completions[ring->cq_head & (ringEntries - 1)];
+        CHECK(c->user_data == 0x1050 + readCompletions);
+        readCompletions++;
+        ring->cq_head++;
+    }
+}
+
+// a full completion ring holds the submissions back instead of overwriting unread completions
+static void test_full(void) {
+    test_setup(4, 0xFFFFFFFC);
+    for (u32 i = 0; i < 4; i++) {
+        test_submit(0x50 + i);
+    }
+
+    // nothing waits for room as long as PPC reads nothing and nothing more is submitted
+    ring_drain();
+    CHECK(handledCount == 4);
+    CHECK(ring->cq_tail - ring->cq_head == 4);
+
+    // PPC may fill the submission ring meanwhile, its completions wait for room
+    for (u32 i = 4; i < 8; i++) {
+        test_submit(0x50 + i);
+    }
+    host_usleep_hook = test_read_completions;
+    ring_drain();
+    host_usleep_hook = NULL;
+    CHECK(handledCount == 8);
+    CHECK(ring->sq_head == ring->sq_tail);
+    CHECK(ring->cq_tail == 0xFFFFFFFC + 8);
+    CHECK(ring->cq_tail - ring->cq_head <= 4);
+    CHECK(readCompletions >= 4);
+    for (u32 i = 0; i < 8; i++) {
+        CHECK(handled[i] == 0x50 + i);
+    }
+}
+
+static void test_setup_args(void) {
+    u8 *mem = host_alloc32(0x4000);
+    CHECK(ring_setup(TEST_FD, mem + 0x20, 4) == IOS_ERROR_INVALID_ARG);
+    CHECK(ring_setup(TEST_FD, mem, 1) == IOS_ERROR_INVALID_ARG);
+    CHECK(ring_setup(TEST_FD, mem, 6) == IOS_ERROR_INVALID_ARG);
+    CHECK(ring_setup(TEST_FD, mem, RING_MAX_ENTRIES * 2) == IOS_ERROR_INVALID_ARG);
+    CHECK(ring_setup(TEST_FD, (void *) (uintptr_t) 0xFFFFFFC0, 4) == IOS_ERROR_INVALID_ARG);
+
+    CHECK(ring_setup(TEST_FD, mem, 2) == 0);
+    CHECK(ring_setup(TEST_FD + 1, mem, 2) == IOS_ERROR_UNKNOWN);
+    ring_close(TEST_FD + 1);
+    CHECK(ring == (RingHeader *) mem);
+    ring_close(TEST_FD);
+    CHECK(ring == NULL);
+    CHECK(ringOwner == -1);
+    CHECK(ring_setup(TEST_FD + 1, mem, 2) == 0);
+    ring_close(TEST_FD + 1);
+}
+
+int main(void) {
+    host_init();
+    ring_init(test_handler);
+
+    test_wrap();
+    test_full();
+    test_setup_args();
+
+    return host_report("ring_test");
+}
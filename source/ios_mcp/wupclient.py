@@ -23,6 +23,41 @@ def get_string(buffer, offset):
     else:
         return s.decode("utf-8")
 
+# server-side scripts, see source/vm.h
+VM_SRC_IMM = 0xFF
+VM_OPS = {"end": 0x00, "li": 0x01, "lea": 0x02, "mov": 0x03,
+          "add": 0x10, "sub": 0x11, "and": 0x12, "or": 0x13, "xor": 0x14, "shl": 0x15, "shr": 0x16, "mul": 0x17,
+          "load32": 0x20, "load8": 0x21, "store32": 0x22, "store8": 0x23, "memcpy": 0x24,
+          "svc": 0x30, "fsa": 0x31, "out": 0x32,
+          "jmp": 0x40, "beq": 0x41, "bne": 0x42, "blt": 0x43, "bltu": 0x44}
+VM_FSA = {"openfile": 0, "openfileex": 1, "readfile": 2, "writefile": 3, "readfilewithpos": 4, "writefilewithpos": 5,
+          "closefile": 6, "getstatfile": 7, "setposfile": 8, "getstat": 9, "opendir": 10, "readdir": 11, "closedir": 12,
+          "makedir": 13, "remove": 14, "rename": 15, "changemode": 16, "mount": 17, "unmount": 18, "flushvolume": 19}
+
+# code is a list of label strings and (op, a, b, c, imm) tuples, data a list of (name, bytes)
+# that is placed behind the code. imm can be a label (jump target) or "@name" (data offset for lea).
+def vm_assemble(code, data = []):
+    labels = {}
+    instructions = []
+    for c in code:
+        if isinstance(c, str):
+            labels[c] = len(instructions)
+        else:
+            instructions.append(c)
+    data_offsets = {}
+    blob = b""
+    for name, value in data:
+        data_offsets[name] = len(instructions) * 8 + len(blob)
+        blob += bytes(value) + b"\0" * (-len(value) % 4)
+    script = b""
+    for c in instructions:
+        op, a, b, r, imm = (tuple(c) + (0, 0, 0, 0))[:5]
+        if isinstance(imm, str):
+            imm = data_offsets[imm[1:]] if imm.startswith("@") else labels[imm]
+        op = VM_OPS[op] if isinstance(op, str) else op
+        script += struct.pack(">II", (op << 24) | (a << 16) | (b << 8) | r, imm & 0xFFFFFFFF)
+    return script + blob
+
 class wupclient:
     s=None
 
@@ -39,6 +74,8 @@ class wupclient:
 
     # fundamental comms
     def send(self, command, data):
+        if self.s == None:
+            raise Exception("the connection was handed to watch_events")
         request = struct.pack('>I', command) + data
 
         self.s.send(request)
@@ -66,6 +103,60 @@ class wupclient:
             print("write error : %08X" % ret)
             return None
 
+    # reads many regions in one round trip, each one is (addr, len) or (addr, len, flags)
+    # flags: 1 = invalidate dcache before the access, 2 = flush dcache after it
+    def readv(self, regions):
+        regions = [(r + (0,))[:3] for r in regions]
+        ret, data = self.send(21, b"".join(struct.pack(">III", *r) for r in regions))
+        res = struct.unpack(">i", data[:4])[0] if ret == 0 else ret
+        if res < 0:
+            print("readv error : %08X" % (res & 0xFFFFFFFF))
+            return None
+        out = []
+        offset = 4
+        for r in regions:
+            out.append(data[offset : (offset + r[1])])
+            offset += r[1]
+        return out
+
+    # writes many regions in one round trip, each one is (addr, data) or (addr, data, flags)
+    def writev(self, patches):
+        data = struct.pack(">I", len(patches))
+        for p in patches:
+            data += struct.pack(">III", p[0], len(p[1]), p[2] if len(p) > 2 else 0)
+        data += b"".join(p[1] for p in patches)
+        ret, _ = self.send(22, data)
+        if ret == 0:
+            return ret
+        else:
+            print("writev error : %08X" % ret)
+            return None
+
+    # kernel memory (MEMTOOLS), reads are split into chunks that fit the command buffer
+    def kernel_read(self, addr, len):
+        data = b""
+        while len > 0:
+            chunk = min(len, 0x5FC)
+            ret, part = self.send(14, struct.pack(">II", addr, chunk))
+            if ret != 0:
+                print("kernel_read error : %08X" % ret)
+                return None
+            data += part
+            addr += chunk
+            len -= chunk
+        return data
+
+    def kernel_write(self, addr, data):
+        while len(data) > 0:
+            chunk = data[:0x5F8]
+            ret, _ = self.send(15, struct.pack(">I", addr) + chunk)
+            if ret != 0:
+                print("kernel_write error : %08X" % ret)
+                return None
+            addr += len(chunk)
+            data = data[len(chunk):]
+        return 0
+
     def svc(self, svc_id, arguments):
         data = struct.pack(">I", svc_id)
         for a in arguments:
@@ -99,19 +190,234 @@ class wupclient:
             print("repeatwrite error : %08X" % ret)
             return None
 
+    # flags: 1 = write, 2 = random, 4 = raw device (read only, path is the device e.g. "/dev/sdcard01")
+    def benchmark(self, path, flags, block_size, op_count, span, queue_depth = 1, raw_sector = 0):
+        data = struct.pack(">IIIIII", flags, block_size, queue_depth, op_count, span, raw_sector)
+        data += bytearray(path, "ascii").ljust(0x100, b"\0")[:0xFF] + b"\0"
+        ret, data = self.send(6, data)
+        if ret != 0:
+            print("benchmark error : %08X" % ret)
+            return None
+        res, ops, nbytes, elapsed_us, kib_per_sec, iops, lat_min, lat_p50, lat_p90, lat_p99, lat_max = struct.unpack(">iIQIIIIIIII", data[:0x30])
+        return {"result": res, "ops": ops, "bytes": nbytes, "elapsed_us": elapsed_us, "mb_per_sec": kib_per_sec / 1024.0, "iops": iops,
+                "latency_us": {"min": lat_min, "p50": lat_p50, "p90": lat_p90, "p99": lat_p99, "max": lat_max}}
+
+    # types: 1 = crc32, 2 = sha1, 4 = sha256; flags: 1 = path is a raw device, offset is the first sector then
+    # length 0 hashes up to the end of the file
+    def hash(self, path, types = 7, offset = 0, length = 0, flags = 0):
+        data = struct.pack(">IIQQ", types, flags, offset, length)
+        data += bytearray(path, "ascii").ljust(0x100, b"\0")[:0xFF] + b"\0"
+        ret, data = self.send(18, data)
+        if ret != 0:
+            print("hash error : %08X" % ret)
+            return None
+        res, elapsed_us, nbytes, crc32, sha1, sha256 = struct.unpack(">iIQI20s32s", data[:0x48])
+        return {"result": res, "bytes": nbytes, "elapsed_us": elapsed_us, "crc32": crc32, "sha1": sha1.hex(), "sha256": sha256.hex()}
+
+    # removes path with everything below it, returns the number of removed entries or the error
+    def remove_tree(self, path):
+        ret, data = self.send(19, bytearray(path, "ascii") + b"\0")
+        if ret != 0:
+            print("remove_tree error : %08X" % ret)
+            return None
+        return struct.unpack(">i", data[:4])[0]
+
+    # creates path and the directories above it, returns the number of created directories or the error
+    def make_dirs(self, path, mode = 0x666):
+        ret, data = self.send(20, struct.pack(">I", mode) + bytearray(path, "ascii") + b"\0")
+        if ret != 0:
+            print("make_dirs error : %08X" % ret)
+            return None
+        return struct.unpack(">i", data[:4])[0]
+
+    # flags: 1 = invalidate dcache before copying, size 0 frees the slot
+    def snapshot(self, slot, addr, size, flags = 0):
+        data = struct.pack(">IIII", slot, addr, size, flags)
+        ret, data = self.send(7, data)
+        if ret == 0:
+            return struct.unpack(">i", data[:4])[0]
+        else:
+            print("snapshot error : %08X" % ret)
+            return None
+
+    # filter: 0 = changed, 1 = unchanged, 2 = increased, 3 = decreased (per u32)
+    # flags: 2 = update the snapshot with the current values
+    # returns a list of (address, current data) ranges
+    def diff(self, slot, size, filter = 0, flags = 0):
+        ranges = []
+        offset = 0
+        while offset < size:
+            ret, data = self.send(8, struct.pack(">IIII", slot, filter, flags, offset))
+            if ret != 0:
+                print("diff error : %08X" % ret)
+                return None
+            res, next_offset = struct.unpack(">iI", data[:8])
+            if res < 0:
+                print("diff error : %08X" % (res & 0xFFFFFFFF))
+                return None
+            records = data[8:8 + res]
+            while len(records) > 0:
+                addr, length = struct.unpack(">II", records[:8])
+                ranges += [(addr, records[8:8 + length])]
+                records = records[8 + length:]
+            if next_offset == offset:
+                break
+            offset = next_offset
+        return ranges
+
+    # search [start, end) for a byte pattern, mask bytes of 0xFF must match and 0x00 are wildcards
+    def search_pattern(self, start, end, pattern, mask = None, max_results = 0x100, flags = 0):
+        if mask == None:
+            mask = bytearray([0xFF] * len(pattern))
+        return self.search(0, start, end, 0, 0, max_results, flags, bytearray(pattern) + bytearray(mask), len(pattern))
+
+    # search for aligned words where (word & mask) == value
+    def search_u32(self, start, end, value, mask = 0xFFFFFFFF, max_results = 0x100, flags = 0):
+        return self.search(1, start, end, value, mask, max_results, flags)
+
+    # search for aligned words where min <= word <= max
+    def search_range(self, start, end, min, max, max_results = 0x100, flags = 0):
+        return self.search(2, start, end, min, max, max_results, flags)
+
+    def search(self, mode, start, end, value, value2, max_results, flags, pattern = bytearray(), pattern_length = 0):
+        results = []
+        while start < end and len(results) < max_results:
+            data = struct.pack(">IIIIIIII", mode, flags, start, end, max_results - len(results), value, value2, pattern_length) + pattern
+            ret, data = self.send(9, data)
+            if ret != 0:
+                print("search error : %08X" % ret)
+                return None
+            res, next_address = struct.unpack(">iI", data[:8])
+            if res < 0:
+                print("search error : %08X" % (res & 0xFFFFFFFF))
+                return None
+            results += list(struct.unpack(">%dI" % res, data[8:8 + res * 4]))
+            start = next_address
+        return results
+
+    # action: 0 = none, 1 = write action_value once then remove, 2 = write action_value on every change
+    # flags: 1 = a change to 0 only updates the old value, 2 = polled every 50us instead of the interval
+    def watch_add(self, address, mask = 0xFFFFFFFF, action = 0, action_value = 0, flags = 0, max_polls = 0):
+        data = struct.pack(">IIIIII", address, mask, flags, action, action_value, max_polls)
+        ret, data = self.send(10, data)
+        if ret != 0:
+            print("watch_add error : %08X" % ret)
+            return None
+        id = struct.unpack(">i", data[:4])[0]
+        if id < 0:
+            print("watch_add error : %08X" % (id & 0xFFFFFFFF))
+            return None
+        return id
+
+    # id -1 removes all watches
+    def watch_remove(self, id = -1):
+        ret, data = self.send(11, struct.pack(">i", id))
+        return ret
+
+    # intervals below 50us are rejected
+    def watch_interval(self, interval_us):
+        ret, data = self.send(13, struct.pack(">I", interval_us))
+        return ret
+
+    # hands this connection to the watch engine and yields (address, old, new, timestamp_us)
+    # wupserver serves one connection at a time, so this client takes no more commands afterwards.
+    # Add the watches first, then the server accepts a new wupclient for everything else.
+    def watch_events(self):
+        if self.fsa_handle != None:
+            self.close(self.fsa_handle)
+            self.fsa_handle = None
+        s = self.s
+        self.s = None
+        s.send(struct.pack(">I", 12))
+        ret = struct.unpack(">I", s.recv(4))[0]
+        if ret != 0:
+            print("watch_events error : %08X" % ret)
+            s.close()
+            return
+        buffer = b""
+        while True:
+            data = s.recv(0x1000)
+            if not data:
+                break
+            buffer += data
+            while len(buffer) >= 16:
+                yield struct.unpack(">IIII", buffer[:16])
+                buffer = buffer[16:]
+        s.close()
+
+    # runs a script from vm_assemble, returns (result, output)
+    def vm(self, script, max_steps = 0):
+        ret, data = self.send(17, struct.pack(">I", max_steps) + script)
+        if ret != 0:
+            print("vm error : %08X" % ret)
+            return None
+        return (struct.unpack(">i", data[:4])[0], data[4:])
+
+    # reads up to size bytes of a file with a single script, returns the data or None
+    def vm_read_file(self, path, size = 0x400):
+        buffer = self.alloc(size, 0x40)
+        if buffer == 0:
+            return None
+        code = [
+            ("lea", 0, 0, 0, "@fsa"), ("li", 1, 0, 0, 0), ("svc", 8, 0, 0, 0x33), # r8 = svcOpen("/dev/fsa", 0)
+            ("li", 12, 0, 0, 0), ("blt", 8, 12, 0, "fail"),
+            ("li", 9, 0, 0, buffer),
+            ("mov", 0, 0, 8), ("lea", 1, 0, 0, "@path"), ("lea", 2, 0, 0, "@mode"), ("lea", 13, 0, 0, "@handle"),
+            ("mov", 3, 0, 13), ("fsa", 11, 0, 0, VM_FSA["openfile"]), ("blt", 11, 12, 0, "done"),
+            ("load32", 10, 13, 0, 0),
+            ("mov", 0, 0, 8), ("mov", 1, 0, 9), ("li", 2, 0, 0, 1), ("li", 3, 0, 0, size), ("mov", 4, 0, 10), ("li", 5, 0, 0, 0),
+            ("fsa", 11, 0, 0, VM_FSA["readfile"]), ("blt", 11, 12, 0, "close"),
+            ("out", 0, 9, 11),
+            "close",
+            ("mov", 0, 0, 8), ("mov", 1, 0, 10), ("fsa", 14, 0, 0, VM_FSA["closefile"]),
+            "done",
+            ("mov", 0, 0, 8), ("svc", 14, 0, 0, 0x34),
+            ("end", 11),
+            "fail",
+            ("end", 8),
+        ]
+        data = [("fsa", b"/dev/fsa\0"), ("path", bytearray(path, "ascii") + b"\0"), ("mode", b"r\0"), ("handle", b"\0" * 4)]
+        res = self.vm(vm_assemble(code, data))
+        self.free(buffer)
+        if res == None:
+            return None
+        if res[0] < 0:
+            print("vm_read_file error : %08X" % (res[0] & 0xFFFFFFFF))
+            return None
+        return res[1]
+
     # derivatives
+    # allocations come from the mocha heap, from 0xCAFF when it is full, could not be created or mocha
+    # was built without HEAP. free tells them apart, mocha rejects addresses it didn't hand out.
     def alloc(self, size, align = None):
         if size == 0:
             return 0
-        if align == None:
-            return self.svc(0x27, [0xCAFF, size])
-        else:
+        ret, data = self.send(24, struct.pack(">II", size, align if align != None else 0))
+        if ret != 0 and ret != 0xFFFFFFFE:
+            print("alloc error : %08X" % ret)
+            return 0
+        address = struct.unpack(">I", data[:4])[0] if ret == 0 else 0
+        if address == 0:
+            if align == None:
+                return self.svc(0x27, [0xCAFF, size])
             return self.svc(0x28, [0xCAFF, size, align])
+        return address
 
     def free(self, address):
         if address == 0:
             return 0
-        return self.svc(0x29, [0xCAFF, address])
+        ret, _ = self.send(25, struct.pack(">I", address))
+        if ret == 0xFFFFFFFE or ret == 0xFFFFFFFD:
+            return self.svc(0x29, [0xCAFF, address])
+        return ret
+
+    # returns (heap_id, size, used, peak_used, allocs, shared_allocs, failures)
+    def heap_info(self):
+        ret, data = self.send(23, b"")
+        if ret != 0:
+            print("heap_info error : %08X" % ret)
+            return None
+        return struct.unpack(">iIIIIII", data[:28])
 
     def load_buffer(self, b, align = None):
         if len(b) == 0: